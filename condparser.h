@@ -8,10 +8,25 @@
         - && (AND)
         - || (OR)
         - ! (NOT)
+        - ^ (XOR), == and != (EQUIVALENCE)
+        - -> (IMPLICATION)
+        - c ? a : b (SELECT)
+        - atleast(N, a, b, ...), atmost(N, a, b, ...), exactly(N, a, b, ...) (THRESHOLD)
+        - id in (a, b, ...) (MEMBERSHIP)
+        - id < N, id <= N, id == N, id >= N, id > N (COMPARISON)
+
+    The threshold operators are true if at least, at most or exactly N of their operands are true.
+    The membership operator is true if the enumerated identifier currently has one of the listed values.
+    The comparison operators compare the value of an integer identifier to a constant, which may be negative.
+    == and != between two boolean operands test whether they are equal, e.g. "a == b" or "a != true". An identifier
+    compared to a number is always an integer comparison, so compare booleans to true and false rather than 1 and 0.
+
+    From the loosest to the tightest binding: ?:, ->, ||, &&, ^, == and !=, !. -> and ?: group to the right.
 
     The parser supports parentheses and identifiers, which are looked up using a callback function.
+    Identifiers may be namespaced with dots, e.g. render.shadows.pcf, and are passed to the callbacks as written.
     It's reentrant, does not use any global variables and does not allocate memory.
-    Constants are not supported, but you can use identifiers to represent them.
+    The constants true, false, 1 and 0 are built in and never reach the callbacks.
 
     I use this parser in my game engine to toggle runtime configuration options based on platform, build configuration, etc.
 
@@ -26,17 +41,298 @@
         - bool getValue(const char* id): This function should return the value of an identifier.
         - void error(const char* message): This function is called to output an error message. Do not add newlines.
 
-    The only API function is:
+    The main API function is:
         bool condParserEvaluate(const char* expr, PFN_condParserGetValue getValue, PFN_condParserError errorFn);
 
     It takes a logical expression, a callback function to get the value of an identifier, and a callback function to output errors,
     and returns the result of the expression.
 
+    Evaluation short-circuits: once an && or || chain (or a threshold) is decided, the text of its remaining
+    operands is skipped without being tokenized and getValue is not called for them. So is the conclusion of an
+    implication whose premise is false and the branch of a select that isn't taken. The skip looks only at
+    parentheses, commas, '|', '?', ':' and '-', 16 bytes at a time where SSE2 is available.
+
+    Expressions using enumerated or integer identifiers need more callbacks, so they are evaluated with:
+        bool condParserEvaluateEx(const char* expr, const CondParserCallbacks* callbacks);
+
+    callbacks->getEnum(const char* id) should return the name of the current value of an enumerated identifier,
+    or NULL if it is unknown. It is called once per membership test, no matter how many values are listed.
+    callbacks->getNumber(const char* id) should return the value of an integer identifier.
+
+    COMPILED PROGRAMS
+    ==================================================
+
+    Expressions that are evaluated many times can be compiled once into a compact bytecode program.
+    Identifiers are resolved to slot indices at compile time, so executing a program needs no callbacks:
+        bool condParserCompile(const char* expr, const CondParserSymbols* symbols, PFN_condParserError errorFn, CondParserProgram* program);
+        bool condParserExecute(const CondParserProgram* program, const CondParserEnv* env);
+        void condParserExecuteBatch(const CondParserProgram* program, const CondParserBatch* batch, uint64_t* results);
+
+    The program is written to a caller-provided buffer (program->code, program->capacity), nothing is allocated.
+    If it doesn't fit, compilation fails with program->size set to program->capacity, e.g. to retry with a larger one.
+    symbols->getSlot returns the slot of an identifier, or -1 if the identifier is unknown.
+    symbols->getField returns the field of an enumerated identifier and symbols->getEnumerator the value (0 to 63)
+    of one of its enumerators, both return -1 if the name is unknown.
+
+    condParserExecute evaluates a program against a bitset, slot N being bit (N % 64) of env->bits[N / 64].
+    condParserExecuteBatch evaluates 64 environments per word in bit-sliced form: batch->columns[N] points to
+    batch->numWords words, bit i of word w holding slot N of environment (w * 64 + i). Bit i of results[w] receives
+    the result for that environment.
+
+    Columns in the Apache Arrow layout, e.g. straight from a memory mapped file, are evaluated in place with:
+        void condParserExecuteArrow(const CondParserProgram* program, const CondParserArrowBatch* batch, CondParserNulls nulls, uint8_t* result, uint8_t* resultValidity);
+    batch->columns[N] holds the bit-packed boolean array of slot N and batch->fields[N] the int32 array of field N,
+    e.g. the indices of a dictionary encoded column, each with an optional validity bitmap and a row offset.
+    batch->length rows are evaluated and the results written as a bit-packed array starting at bit 0 of result.
+    With CondParserNulls_False null slots read as false and null fields match no enumerator. With
+    CondParserNulls_Unknown a result is null if any slot or field the program reads is null, like Arrow's non Kleene
+    kernels, and the validity of the results is written to resultValidity if it's not NULL. With
+    CondParserNulls_Kleene nulls are unknown values under Kleene logic, like Arrow's Kleene kernels: a result is only
+    null if it depends on an unknown value, e.g. "a || b" is true wherever b is true, whatever a is.
+
+    Batches with missing values are evaluated the same way with a second bit-plane per slot or field telling whether
+    its value is known:
+        void condParserExecuteKleene(const CondParserProgram* program, const CondParserBatch* batch, const CondParserKnown* known, uint64_t* resultTrue, uint64_t* resultFalse, uint64_t* resultUnknown);
+    Bit i of word w of known->columns[N] is set if slot N of environment (w * 64 + i) is known. The results are
+    three batch->numWords word bitmaps of the environments where the program is definitely true, definitely false or
+    unknown, the last one may be NULL. Every instruction is a handful of bitwise operations on the two planes.
+
+    When some identifiers are slow to resolve, a program can be evaluated right away with their last known values:
+        bool condParserSpeculate(const CondParserProgram* program, const CondParserEnv* env, const uint64_t* pendingSlots, const uint64_t* pendingFields, CondParserSpeculation* speculation);
+        bool condParserConfirm(const CondParserProgram* program, const CondParserEnv* env, const uint64_t* changedSlots, const uint64_t* changedFields, CondParserSpeculation* speculation);
+
+    pendingSlots and pendingFields are bitsets of the slots and fields holding last known values, either may be NULL.
+    condParserSpeculate returns the provisional result and stores it in speculation->result, along with the pending
+    slots and fields the evaluation actually read; if there are none the result is final. Once the real values are
+    in env, condParserConfirm is given the bitsets of those that differ from the last known ones. It only evaluates
+    the program again if the result read one of them, and returns whether the result changed.
+
+    Environments stored as rows, e.g. one bitset per entity, are transposed into columns for condParserExecuteBatch with:
+        void condParserTransposeRows(const uint64_t* rows, int rowWords, int numEnvs, uint64_t* columns, int numSlots);
+    rows holds numEnvs bitsets of rowWords words, columns receives numSlots columns of (numEnvs + 63) / 64 words,
+    slot N starting at columns + N * ((numEnvs + 63) / 64). condParserTransposeColumns does the inverse, e.g. to
+    scatter the results of a batch back into per-entity flags. It overwrites the row words holding the slots, the bits
+    past numSlots are cleared.
+
+    A rule usually reads a handful of slots, so across many rows the part it depends on repeats. Rows can be grouped
+    by that projection, evaluated once per group, e.g. with slow callbacks, and the results scattered back:
+        bool condParserProjectionMask(const CondParserProgram* program, uint64_t* mask);
+        int condParserDedupRows(const uint64_t* mask, int maskWords, const uint64_t* rows, int rowWords, int numEnvs, CondParserDedup* dedup);
+        void condParserScatterGroups(const CondParserDedup* dedup, int numEnvs, const uint64_t* groupResults, uint64_t* results);
+
+    condParserProjectionMask adds the slots a program reads to mask, (program->numSlots + 63) / 64 words; call it for
+    every rule of a ruleset to group by their union. Rows only hold slots, so it returns false if the program reads a
+    field: rows of one group may then differ in it, evaluate such rules per row. condParserDedupRows hashes the masked words of every row into
+    dedup->buckets (a power of two of at least numEnvs + 1 ints, about twice that keeps probes short), writes the group
+    of every row to dedup->groups and the first row of every group to dedup->representatives (numEnvs ints each). It
+    returns the number of groups, or -1 if the buckets are full. Evaluate the representatives, set bit (g % 64) of
+    groupResults[g / 64] to the result of group g and condParserScatterGroups writes the result of every row to
+    results, (numEnvs + 63) / 64 words.
+
+    Enumerated identifiers are read from integer fields: env->fields[N] for condParserExecute, and
+    batch->fields[N][e] for environment e in condParserExecuteBatch (holding batch->numWords * 64 values).
+    A membership test compiles to a single load and mask test, regardless of the number of listed values.
+    Integer identifiers are fields too, symbols->getField returns their field. A comparison compiles to a single
+    range check, done 4 values at a time with SSE2 in condParserExecuteBatch and condParserExecuteArrow.
+
+    ^, ==, !=, -> and ?: compile to single instructions, which are bitwise operations in condParserExecuteBatch.
+
+    Constants are folded at compile time, e.g. "a && true" compiles to the same program as "a", and "a || true"
+    to a program that is always true without reading any slot. So are thresholds decided by their number of operands,
+    e.g. "atleast(3, a, b)" is always false and "atmost(2, a, b)" always true.
+
+    Expressions can also be split into tokens up front, e.g. to intern the identifiers of a whole rule file before
+    compiling its rules:
+        int condParserTokenize(const char* expr, CondParserTokenSpan* tokens, int capacity, PFN_condParserError errorFn);
+        bool condParserCompileTokens(const char* expr, const CondParserTokenSpan* tokens, const CondParserSymbols* symbols, PFN_condParserError errorFn, CondParserProgram* program);
+
+    condParserTokenize writes one span per token, the last one being CondParserToken_End, and returns the number of
+    spans or -1 on error. Identifier and keyword spans carry their condParserHash(id, length) so hosts can look them
+    up without hashing again. Runs of whitespace, identifier characters and digits are classified 16 bytes at a time where
+    SSE2 is available. condParserCompileTokens compiles the spans of expr as condParserCompile would.
+
+    VERIFICATION
+    ==================================================
+
+    Programs are plain byte buffers, so they can be cached, shared or shipped in rule packs. Before executing a
+    program that didn't come straight from condParserCompile, verify it against the environments it will run on:
+        bool condParserVerify(CondParserProgram* program, int numSlots, int numFields, PFN_condParserError errorFn);
+
+    In one pass it checks that all opcodes are valid, that jumps land on instructions inside the program, that slots
+    and fields are in range and that the stack never underflows or overflows and ends with exactly one value.
+    Jumps only go forward, so every program terminates. On success it recomputes program->numSlots, numFields and
+    maxStack and sets program->verified.
+
+    condParserCompile marks its output as verified. Verified programs skip the bounds checks at run time; unverified
+    ones are bounds-checked on every instruction and evaluate to false if they turn out to be malformed. Clear
+    program->verified if you modify the code of a verified program.
+
+    RULESETS
+    ==================================================
+
+    A ruleset is an array of compiled rules with one CondParserRuleInfo per rule. Before evaluating it, analyse it once:
+        int condParserAnalyzeRuleset(CondParserRuleset* ruleset, int budget);
+        int condParserExecuteRuleset(const CondParserRuleset* ruleset, const CondParserEnv* env, uint64_t* results);
+
+    The analysis computes the truth table of every rule over the slots it reads and reduces it to the slots the result
+    actually depends on. Rules that turn out to be constant are flagged CondParserTruth_Always or CondParserTruth_Never
+    (tautologies and contradictions), and a rule computing the same function as an earlier one, however it is spelled,
+    gets that rule as info->shared. It returns the number of rules that still need to be evaluated.
+
+    budget caps the number of program executions spent on truth tables, a rule whose table doesn't fit stays
+    CondParserTruth_Unknown. So do rules reading fields or more than CONDPARSER_ANALYSIS_SLOTS slots, these
+    are only merged with byte-identical earlier rules.
+
+    condParserExecuteRuleset sets bit (r % 64) of results[r / 64] to the result of rule r, evaluating every shared
+    rule once and constant rules not at all. It returns the number of programs it executed.
+
+    If ruleset->order (numRules ints) and the settleTrue and settleFalse matrices (numRules rows of (numRules + 63) / 64
+    words each) are set, the analysis also finds which rules imply which, within the same budget. It orders the rules
+    so that the ones related to the most others are evaluated first, and records for every rule the earlier rules that
+    settle it: a rule implied by a true rule is true, and a rule implying a false rule is false, without executing it.
+    So a false general rule prunes all of its specialisations, and a true specific rule settles its generalisations.
+
+    For ranking, ruleset->weights (numRules floats) gives every rule a weight, and an environment scores the sum of
+    the weights of the rules it matches:
+        float condParserScoreRuleset(const CondParserRuleset* ruleset, const CondParserEnv* env, uint64_t* results);
+        void condParserScoreBatch(const CondParserRuleset* ruleset, const CondParserBatch* batch, uint64_t* ruleWords, float* scores);
+
+    condParserScoreRuleset evaluates the ruleset like condParserExecuteRuleset and returns the score, leaving the
+    results in results. condParserScoreBatch writes the scores of all batch->numWords * 64 environments to scores,
+    64 environments at a time: each rule's result word (ruleWords holds one per rule) is added to the 64 scores as a
+    mask over its weight, 4 lanes at a time with SSE2. Constant rules cost a single add and duplicates reuse the word
+    of the rule they share, but implications are not used.
+
+    Rules over the same few slots, e.g. platform and quality tier flags, can be evaluated together from truth tables:
+        int condParserGroupRuleset(const CondParserRuleset* ruleset, CondParserTableGroups* groups);
+        int condParserExecuteGrouped(const CondParserRuleset* ruleset, const CondParserTableGroups* groups, const CondParserEnv* env, uint64_t* results);
+
+    condParserGroupRuleset puts every analysed rule that reads at most 6 slots and is neither constant nor a duplicate
+    into a group of rules whose slots together are still at most 6, and stores each rule's 64-bit truth table over
+    its group's slots. groups->groups holds up to groups->capacity groups, groups->rules and groups->tables numRules
+    entries and groups->grouped (numRules + 63) / 64 words; it returns the number of rules grouped.
+    condParserExecuteGrouped computes the table index of every group once, reads the result of each of its rules with
+    a single shift, then evaluates the remaining rules like condParserExecuteRuleset. It returns the number of
+    programs it executed.
+
+    When the environment changes a little at a time, e.g. between frames, a cursor keeps the results up to date
+    incrementally and spreads the work over several calls:
+        void condParserRuleCursorInit(CondParserRuleCursor* cursor, const CondParserRuleset* ruleset, uint64_t* pending);
+        void condParserRuleCursorInvalidate(CondParserRuleCursor* cursor, const CondParserRuleset* ruleset, const uint64_t* slots, int numSlots, const uint64_t* fields, int numFields);
+        int condParserResumeRuleset(const CondParserRuleset* ruleset, CondParserRuleCursor* cursor, const CondParserEnv* env, uint64_t* results, int budget);
+
+    pending holds (numRules + 63) / 64 words and starts with every rule pending. condParserRuleCursorInvalidate marks
+    the rules reading any of the given slots or fields (bitsets of numSlots and numFields bits, either may be NULL) as
+    pending, all other results stay valid. condParserResumeRuleset evaluates pending rules in evaluation order,
+    updating their bits of results, until budget programs have been executed, and returns the number of rules still
+    pending, 0 once results match the environment. Rules settled without executing their program don't use up the
+    budget. With a time budget, call it with a small budget until the time runs out.
+
+    PLANNING
+    ==================================================
+
+    Given how likely each slot is to be true and how much it costs to read, from the host or from profiling, a rule can
+    be compiled for the lowest expected cost instead of in source order:
+        bool condParserCompilePlanned(const char* expr, const CondParserSymbols* symbols, const CondParserStats* stats, PFN_condParserError errorFn, CondParserProgram* program);
+
+    The operands of every && and || chain are reordered by their cost over the chance that they end the chain, which is
+    the cheapest short-circuit order for independent operands. The probabilities and expected costs of subexpressions,
+    thresholds included, are computed bottom up. If the rule reads at most 6 slots and a single truth table lookup
+    reading all of them is expected to be cheaper, that is what the program becomes. The result is the same as
+    condParserCompile's for every environment and the program is verified. Without stats (NULL) it's condParserCompile.
+
+    VERSIONED ENVIRONMENTS
+    ==================================================
+
+    Many versions of an environment, e.g. per-request snapshots or what-if runs, can be kept alive at once as
+    copy-on-write bitsets split into chunks of CONDPARSER_VERSION_CHUNK_WORDS words:
+        void condParserVersionArenaInit(CondParserVersionArena* arena, uint64_t* words, int capacity, const uint64_t** pointers, int pointerCapacity);
+        bool condParserVersionInit(CondParserVersion* version, CondParserVersionArena* arena, const uint64_t* bits, int numSlots);
+        bool condParserVersionSet(CondParserVersion* version, const CondParserVersion* base, CondParserVersionArena* arena, const int* slots, const bool* values, int numChanges);
+        bool condParserVersionGet(const CondParserVersion* version, int slot);
+        bool condParserExecuteVersion(const CondParserProgram* program, const CondParserVersion* version, const int32_t* fields);
+
+    A version is a table of pointers to immutable chunks, so copying the struct takes a snapshot. condParserVersionSet
+    makes a new version of base with numChanges slots set to the given values (version and base may be the same):
+    it copies the chunk table and only the chunks holding changed slots, every other chunk is shared with base.
+    condParserVersionInit copies a bitset of numSlots slots, all-zero chunks share a single chunk. Chunks and
+    chunk tables are taken from the arena, a pair of caller-provided buffers that are only released as a whole, by
+    initialising the arena again. Both return false, leaving the arena as it was, if it runs out.
+
+    condParserExecuteVersion evaluates a program against a version and the fields. A program reading only the first
+    chunk reads it in place as a bitset, otherwise every word is read through the chunk table. Slots past the
+    version's numSlots read as false.
+
+    SYMBOL TABLES
+    ==================================================
+
+    Instead of a getSlot callback, slots can be assigned by a symbol table: a prefix trie of dotted identifiers
+    stored in caller-provided nodes (one node per distinct name component):
+        void condParserSymbolTableInit(CondParserSymbolTable* table, CondParserSymbolNode* nodes, int capacity);
+        bool condParserSymbolTableAdd(CondParserSymbolTable* table, const char* name);
+        void condParserSymbolTableAssign(CondParserSymbolTable* table);
+        int condParserSymbolTableSlot(const CondParserSymbolTable* table, const char* name);
+        bool condParserSymbolTableRange(const CondParserSymbolTable* table, const char* prefix, int* firstSlot, int* numSlots);
+
+    The table keeps pointers to the added names, so they must outlive it. condParserSymbolTableAssign numbers all
+    names depth-first, which gives every namespace a contiguous range of slots; call it after the last add and before
+    compiling. Set symbols->table (and leave symbols->getSlot NULL) to compile against the table.
+
+    Threads that compile or load rules in parallel can instead share an interner, an open-addressing hash table in
+    caller-provided storage that hands out slots in first-come order:
+        void condParserInternerInit(CondParserInterner* interner, uint64_t* buckets, int capacity, const char** names, int maxSlots, char* chars, int charCapacity);
+        int condParserIntern(CondParserInterner* interner, const char* name, int length);
+        int condParserInternerSlot(const CondParserInterner* interner, const char* name, int length);
+        const char* condParserInternerName(const CondParserInterner* interner, int slot);
+
+    capacity should be a power of two, larger than maxSlots to keep probes short; other capacities only use their
+    largest power of two of buckets. The names are copied into chars.
+    condParserIntern returns the slot of a name, adding it if it's new, or -1 once the buckets, slots or chars run
+    out. A slot never changes once handed out, so programs compiled by different threads share one slot space.
+    Lookups take no lock and never wait; inserts claim a bucket with a compare-and-swap and only wait for
+    another thread that is inserting a name with the same hash, spinning until it's done, so inserts block on
+    each other when their hashes collide. The bucket of an insert that ran out of slots or chars is reused by
+    the next name with its hash. condParserInternerName returns NULL for a slot whose name isn't published yet,
+    e.g. one another thread is still inserting. Set symbols->interner (and leave getSlot and table NULL) to
+    intern identifiers while compiling. The atomics use the GCC/Clang builtins or the MSVC intrinsics; other
+    compilers get plain accesses and must not share an interner between threads.
+
+    Namespace-wide defaults and overrides are then applied to a bitset with one mask operation per word:
+        void condParserSetRange(uint64_t* bits, int firstSlot, int numSlots, bool value);
+        void condParserCopyRange(uint64_t* dst, const uint64_t* src, int firstSlot, int numSlots);
+
+    Threshold operands that are plain identifiers compile to a mask-and-popcount against bitsets and to an adder
+    network in batch mode, so large quorum rules stay linear in the number of operands.
+
     You can define the following macros to customise the parser:
         - CONDPARSER_STRNCMP: The string comparison function to use. Default: strncmp
         - CONDPARSER_ID_LENGTH: The maximum length of an identifier. Default: 32
+        - CONDPARSER_STACK_SIZE: The maximum evaluation stack depth of a compiled program. Default: 64
+        - CONDPARSER_MASK_WORDS: The maximum number of 64-slot words a threshold mask spans. Default: 16
+        - CONDPARSER_POPCOUNT64: The 64-bit population count to use. Default: compiler builtin or a portable fallback
+        - CONDPARSER_ANALYSIS_SLOTS: The maximum number of slots a rule may read to be analysed. Default: 12
+        - CONDPARSER_VERSION_CHUNK_WORDS: The number of 64-slot words in a chunk of a versioned environment. Default: 4
+        - CONDPARSER_NO_SIMD: Define to disable the SSE2 code paths.
+        - CONDPARSER_INLINE_PROGRAM_SIZE: The bytecode a C++ condparser::program holds without allocating. Default: 64
+
+    string.h is only included if CONDPARSER_STRNCMP is not defined, the implementation always includes stddef.h.
+
+    C++
+    ==================================================
 
-    string.h is only included if CONDPARSER_STRNCMP is not defined.
+    With C++17, compiled programs can be held by a move-only value type that stores small programs inline:
+        template <class Allocator = std::allocator<unsigned char>> class condparser::basic_program;
+        using condparser::program = condparser::basic_program<>;
+
+    program::compile(std::string_view expr, const CondParserSymbols& symbols, PFN_condParserError errorFn) compiles
+    into the inline buffer of CONDPARSER_INLINE_PROGRAM_SIZE bytes and only takes a larger buffer from the allocator
+    if the program doesn't fit; expressions of 256 characters or more are also copied through the allocator to be
+    null-terminated. Moves copy inline programs, a program holding an allocated buffer hands it over. Move assignment
+    follows the allocator's propagate_on_container_move_assignment: between unequal allocators that don't propagate,
+    the code is copied into a buffer of the target's allocator, so only that assignment may throw.
+    execute and execute_batch wrap condParserExecute and condParserExecuteBatch, get() returns the CondParserProgram
+    for the rest of the API. A failed compile leaves the program as it was and reports the errors of its last
+    attempt, the one with a large enough buffer.
 
     LICENSE
     ==================================================
@@ -65,31 +361,151 @@
 */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef bool(*PFN_condParserGetValue)(const char*);
 typedef void (*PFN_condParserError)(const char*);
+typedef const char* (*PFN_condParserGetEnum)(const char*);
+typedef int (*PFN_condParserGetSlot)(const char*);
+typedef int (*PFN_condParserGetEnumerator)(const char*, const char*);
+typedef int32_t (*PFN_condParserGetNumber)(const char*);
 
-#ifdef __cplusplus
-extern "C" {
-#endif
+typedef struct
+{
+    PFN_condParserGetValue getValue;
+    PFN_condParserGetEnum getEnum;
+    PFN_condParserError errorFn;
+    PFN_condParserGetNumber getNumber;
+} CondParserCallbacks;
 
-    bool condParserEvaluate(const char* expr, PFN_condParserGetValue getValue, PFN_condParserError errorFn);
+typedef struct
+{
+    const char* name;   // one component of a dotted identifier, not null-terminated
+    int length;
+    int firstChild;
+    int nextSibling;
+    bool defined;       // added as an identifier, not only as a namespace
+    int slot;
+    int firstSlot;      // slots of the node and its descendants
+    int numSlots;
+} CondParserSymbolNode;
 
-#ifdef __cplusplus
-}
-#endif
+typedef struct
+{
+    CondParserSymbolNode* nodes;
+    int capacity;
+    int numNodes;
+    int numSlots;
+} CondParserSymbolTable;
 
-#ifdef CONDPARSER_IMPLEMENTATION
+typedef struct
+{
+    uint64_t* buckets;      // the hash in the high half, slot + 1 in the low half, 0 when empty
+    int capacity;
+    const char** names;     // the name of every slot
+    int maxSlots;
+    char* chars;            // null-terminated copies of the names
+    int charCapacity;
+    int numSlots;           // updated atomically
+    int numChars;
+} CondParserInterner;
 
-#ifndef CONDPARSER_STRNCMP
-#include <string.h>
-#define CONDPARSER_STRNCMP strncmp
-#endif
+typedef struct
+{
+    PFN_condParserGetSlot getSlot;
+    PFN_condParserGetSlot getField;
+    PFN_condParserGetEnumerator getEnumerator;
+    const CondParserSymbolTable* table;
+    CondParserInterner* interner;
+} CondParserSymbols;
 
-#ifndef CONDPARSER_ID_LENGTH
-#define CONDPARSER_ID_LENGTH 32
+typedef struct
+{
+    unsigned char* code;
+    int capacity;
+    int size;
+    int numSlots;
+    int numFields;
+    int maxStack;
+    bool verified;
+} CondParserProgram;
+
+typedef struct
+{
+    const uint64_t* bits;
+    const int32_t* fields;
+} CondParserEnv;
+
+#ifndef CONDPARSER_VERSION_CHUNK_WORDS
+#define CONDPARSER_VERSION_CHUNK_WORDS 4
 #endif
 
+typedef struct
+{
+    const uint64_t* const* chunks;  // CONDPARSER_VERSION_CHUNK_WORDS words each, shared between versions
+    int numSlots;
+} CondParserVersion;
+
+typedef struct
+{
+    uint64_t* words;            // storage for chunks
+    int capacity;
+    int numWords;
+    const uint64_t** pointers;  // storage for chunk tables
+    int pointerCapacity;
+    int numPointers;
+} CondParserVersionArena;
+
+typedef struct
+{
+    uint64_t* slots;    // pending slots the result depends on, (program->numSlots + 63) / 64 words
+    uint64_t* fields;   // same for fields, (program->numFields + 63) / 64 words, may be NULL if the program reads none
+    bool result;
+} CondParserSpeculation;
+
+typedef struct
+{
+    int* buckets;           // capacity ints, a power of two
+    int capacity;
+    int* groups;            // the group of every row
+    int* representatives;   // the first row of every group
+    int numGroups;
+} CondParserDedup;
+
+typedef struct
+{
+    const uint64_t* const* columns;
+    int numWords;
+    const int32_t* const* fields;
+} CondParserBatch;
+
+typedef struct
+{
+    const void* values;         // LSB-ordered bits for slots, int32_t values for fields
+    const uint8_t* validity;    // LSB-ordered, set for valid rows, NULL without nulls
+    int64_t offset;             // row of both buffers holding the first row of the batch
+} CondParserArrowArray;
+
+typedef struct
+{
+    const CondParserArrowArray* columns;
+    const CondParserArrowArray* fields;
+    int64_t length;
+} CondParserArrowBatch;
+
+typedef enum
+{
+    CondParserNulls_False,      // null slots read as false, null fields match no enumerator
+    CondParserNulls_Unknown,    // results depending on a null are null
+    CondParserNulls_Kleene      // nulls are unknown values, results are null unless they are known regardless
+} CondParserNulls;
+
+typedef struct
+{
+    const uint64_t* const* columns;     // per slot, bit set where the slot's value is known, NULL columns are all known
+    const uint64_t* const* fields;      // same per field, may be NULL
+} CondParserKnown;
+
 typedef enum
 {
     CondParserToken_ID,
@@ -98,223 +514,5078 @@ typedef enum
     CondParserToken_Not,
     CondParserToken_And,
     CondParserToken_Or,
+    CondParserToken_Comma,
+    CondParserToken_Number,
+    CondParserToken_AtLeast,
+    CondParserToken_AtMost,
+    CondParserToken_Exactly,
+    CondParserToken_In,
+    CondParserToken_True,
+    CondParserToken_False,
+    CondParserToken_Less,
+    CondParserToken_LessEqual,
+    CondParserToken_Equal,
+    CondParserToken_NotEqual,
+    CondParserToken_GreaterEqual,
+    CondParserToken_Greater,
+    CondParserToken_Xor,
+    CondParserToken_Implies,
+    CondParserToken_Question,
+    CondParserToken_Colon,
     CondParserToken_End
 } CondParserTokenType;
 
 typedef struct
 {
     CondParserTokenType type;
-    char id[CONDPARSER_ID_LENGTH];
-} CondParserToken;
+    int offset;         // position of the token in the expression
+    int length;
+    int number;         // value of number tokens
+    uint32_t hash;      // condParserHash of identifiers and keywords
+} CondParserTokenSpan;
 
 typedef struct
 {
-    const char* cur;
-    CondParserToken curToken;
-    bool error;
-    PFN_condParserGetValue getValue;
-    PFN_condParserError errorFn;
-} CondParserContext;
+    const float* probability;   // per slot, the chance that the slot is true
+    const float* cost;          // per slot, the cost of reading it
+    int numSlots;               // slots past the arrays count as true half the time at cost 1
+    float instructionCost;      // cost of dispatching one instruction
+} CondParserStats;
+
+typedef enum
+{
+    CondParserTruth_Unknown,        // not analysed: reads fields, too many slots or out of budget
+    CondParserTruth_Contingent,
+    CondParserTruth_Always,
+    CondParserTruth_Never
+} CondParserTruth;
+
+typedef struct
+{
+    CondParserTruth truth;
+    int shared;             // the rule evaluated in place of this one, the rule itself unless it duplicates an earlier rule
+    uint64_t fingerprint;   // hash of the function the rule computes, equal for equivalent rules
+    int position;           // index of the rule in ruleset->order
+} CondParserRuleInfo;
+
+typedef struct
+{
+    const CondParserProgram* rules;
+    CondParserRuleInfo* info;
+    int numRules;
+    int* order;             // optional evaluation order, enables implication analysis
+    uint64_t* settleTrue;   // numRules rows of (numRules + 63) / 64 words, required with order
+    uint64_t* settleFalse;  // same as settleTrue
+    const float* weights;   // optional weight of every rule, for scoring
+} CondParserRuleset;
+
+typedef struct
+{
+    int slots[6];           // the slots of the group, bit j of a table index is slots[j]
+    int numSlots;
+    int firstRule;          // index of the group's first rule in groups->rules
+    int numRules;
+} CondParserTableGroup;
+
+typedef struct
+{
+    CondParserTableGroup* groups;
+    int capacity;
+    int numGroups;
+    int* rules;             // the grouped rules, group by group
+    uint64_t* tables;       // the truth table of every rule in rules over its group's slots
+    uint64_t* grouped;      // bitset of the grouped rules
+} CondParserTableGroups;
+
+typedef struct
+{
+    uint64_t* pending;      // numRules bits: rules whose results are out of date, (numRules + 63) / 64 words
+    int numPending;
+    int position;           // index in the evaluation order before which no rule is pending
+} CondParserRuleCursor;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-    static bool condParserIsSpace(char c)
-    {
-        return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\v') || (c == '\f') || (c == '\r');
-    }
+    bool condParserEvaluate(const char* expr, PFN_condParserGetValue getValue, PFN_condParserError errorFn);
+    bool condParserEvaluateEx(const char* expr, const CondParserCallbacks* callbacks);
 
-    static bool condParserIsAlpha(char c)
-    {
-        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
-    }
+    bool condParserCompile(const char* expr, const CondParserSymbols* symbols, PFN_condParserError errorFn, CondParserProgram* program);
+    bool condParserExecute(const CondParserProgram* program, const CondParserEnv* env);
+    bool condParserSpeculate(const CondParserProgram* program, const CondParserEnv* env, const uint64_t* pendingSlots, const uint64_t* pendingFields, CondParserSpeculation* speculation);
+    bool condParserConfirm(const CondParserProgram* program, const CondParserEnv* env, const uint64_t* changedSlots, const uint64_t* changedFields, CondParserSpeculation* speculation);
+    void condParserVersionArenaInit(CondParserVersionArena* arena, uint64_t* words, int capacity, const uint64_t** pointers, int pointerCapacity);
+    bool condParserVersionInit(CondParserVersion* version, CondParserVersionArena* arena, const uint64_t* bits, int numSlots);
+    bool condParserVersionSet(CondParserVersion* version, const CondParserVersion* base, CondParserVersionArena* arena, const int* slots, const bool* values, int numChanges);
+    bool condParserVersionGet(const CondParserVersion* version, int slot);
+    bool condParserExecuteVersion(const CondParserProgram* program, const CondParserVersion* version, const int32_t* fields);
+    void condParserExecuteBatch(const CondParserProgram* program, const CondParserBatch* batch, uint64_t* results);
+    void condParserExecuteArrow(const CondParserProgram* program, const CondParserArrowBatch* batch, CondParserNulls nulls, uint8_t* result, uint8_t* resultValidity);
+    void condParserExecuteKleene(const CondParserProgram* program, const CondParserBatch* batch, const CondParserKnown* known, uint64_t* resultTrue, uint64_t* resultFalse, uint64_t* resultUnknown);
+    bool condParserVerify(CondParserProgram* program, int numSlots, int numFields, PFN_condParserError errorFn);
+    void condParserTransposeRows(const uint64_t* rows, int rowWords, int numEnvs, uint64_t* columns, int numSlots);
+    void condParserTransposeColumns(const uint64_t* columns, int numSlots, int numEnvs, uint64_t* rows, int rowWords);
+    bool condParserProjectionMask(const CondParserProgram* program, uint64_t* mask);
+    int condParserDedupRows(const uint64_t* mask, int maskWords, const uint64_t* rows, int rowWords, int numEnvs, CondParserDedup* dedup);
+    void condParserScatterGroups(const CondParserDedup* dedup, int numEnvs, const uint64_t* groupResults, uint64_t* results);
 
-    static bool condParserIsAlnum(char c)
-    {
-        return condParserIsAlpha(c) || (c >= '0' && c <= '9');
-    }
+    int condParserTokenize(const char* expr, CondParserTokenSpan* tokens, int capacity, PFN_condParserError errorFn);
+    bool condParserCompileTokens(const char* expr, const CondParserTokenSpan* tokens, const CondParserSymbols* symbols, PFN_condParserError errorFn, CondParserProgram* program);
+    uint32_t condParserHash(const char* id, int length);
+    bool condParserCompilePlanned(const char* expr, const CondParserSymbols* symbols, const CondParserStats* stats, PFN_condParserError errorFn, CondParserProgram* program);
 
-    static void condParserPrintError(const CondParserContext* ctx, const char* msg)
+    int condParserAnalyzeRuleset(CondParserRuleset* ruleset, int budget);
+    int condParserExecuteRuleset(const CondParserRuleset* ruleset, const CondParserEnv* env, uint64_t* results);
+    float condParserScoreRuleset(const CondParserRuleset* ruleset, const CondParserEnv* env, uint64_t* results);
+    void condParserScoreBatch(const CondParserRuleset* ruleset, const CondParserBatch* batch, uint64_t* ruleWords, float* scores);
+    int condParserGroupRuleset(const CondParserRuleset* ruleset, CondParserTableGroups* groups);
+    int condParserExecuteGrouped(const CondParserRuleset* ruleset, const CondParserTableGroups* groups, const CondParserEnv* env, uint64_t* results);
+    void condParserRuleCursorInit(CondParserRuleCursor* cursor, const CondParserRuleset* ruleset, uint64_t* pending);
+    void condParserRuleCursorInvalidate(CondParserRuleCursor* cursor, const CondParserRuleset* ruleset, const uint64_t* slots, int numSlots, const uint64_t* fields, int numFields);
+    int condParserResumeRuleset(const CondParserRuleset* ruleset, CondParserRuleCursor* cursor, const CondParserEnv* env, uint64_t* results, int budget);
+
+    void condParserSymbolTableInit(CondParserSymbolTable* table, CondParserSymbolNode* nodes, int capacity);
+    bool condParserSymbolTableAdd(CondParserSymbolTable* table, const char* name);
+    void condParserSymbolTableAssign(CondParserSymbolTable* table);
+    int condParserSymbolTableSlot(const CondParserSymbolTable* table, const char* name);
+    bool condParserSymbolTableRange(const CondParserSymbolTable* table, const char* prefix, int* firstSlot, int* numSlots);
+    void condParserInternerInit(CondParserInterner* interner, uint64_t* buckets, int capacity, const char** names, int maxSlots, char* chars, int charCapacity);
+    int condParserIntern(CondParserInterner* interner, const char* name, int length);
+    int condParserInternerSlot(const CondParserInterner* interner, const char* name, int length);
+    const char* condParserInternerName(const CondParserInterner* interner, int slot);
+    void condParserSetRange(uint64_t* bits, int firstSlot, int numSlots, bool value);
+    void condParserCopyRange(uint64_t* dst, const uint64_t* src, int firstSlot, int numSlots);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(__cplusplus) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifndef CONDPARSER_INLINE_PROGRAM_SIZE
+#define CONDPARSER_INLINE_PROGRAM_SIZE 64
+#endif
+
+namespace condparser
+{
+    template <class Allocator = std::allocator<unsigned char>>
+    class basic_program
     {
-        if (ctx->errorFn)
+    public:
+        static constexpr int inline_capacity = CONDPARSER_INLINE_PROGRAM_SIZE;
+
+        basic_program() noexcept
         {
-            ctx->errorFn(msg);
+            reset();
         }
-    }
 
-    static void condParserPrintToken(const CondParserContext* ctx)
-    {
-        switch (ctx->curToken.type)
+        explicit basic_program(const Allocator& allocator) noexcept
+            : m_allocator(allocator)
         {
-        case CondParserToken_ID:
-            condParserPrintError(ctx, "ID [");
-            condParserPrintError(ctx, ctx->curToken.id);
-            condParserPrintError(ctx, "]");
-            break;
-        case CondParserToken_LParen:
-            condParserPrintError(ctx, "LPAREN");
-            break;
-        case CondParserToken_RParen:
-            condParserPrintError(ctx, "RPAREN");
-            break;
-        case CondParserToken_Not:
-            condParserPrintError(ctx, "NOT");
-            break;
-        case CondParserToken_And:
-            condParserPrintError(ctx, "AND");
-            break;
-        case CondParserToken_Or:
-            condParserPrintError(ctx, "OR");
-            break;
-        case CondParserToken_End:
-            condParserPrintError(ctx, "END");
-            break;
-        default:
-            condParserPrintError(ctx, "<<UNKNOWN TOKEN>>");
-            break;
+            reset();
         }
-    }
-
-    static void condParserNextToken(CondParserContext* ctx)
-    {
-        // skip ws
-        while (condParserIsSpace(*ctx->cur)) ctx->cur++;
 
-        if (*ctx->cur == '\0') {
-            ctx->curToken.type = CondParserToken_End;
-        }
-        else if (CONDPARSER_STRNCMP(ctx->cur, "&&", 2) == 0) {
-            ctx->curToken.type = CondParserToken_And;
-            ctx->cur += 2;
-        }
-        else if (CONDPARSER_STRNCMP(ctx->cur, "||", 2) == 0) {
-            ctx->curToken.type = CondParserToken_Or;
-            ctx->cur += 2;
-        }
-        else if (*ctx->cur == '!') {
-            ctx->curToken.type = CondParserToken_Not;
-            ctx->cur++;
-        }
-        else if (*ctx->cur == '(') {
-            ctx->curToken.type = CondParserToken_LParen;
-            ctx->cur++;
-        }
-        else if (*ctx->cur == ')') {
-            ctx->curToken.type = CondParserToken_RParen;
-            ctx->cur++;
+        basic_program(basic_program&& other) noexcept
+            : m_allocator(std::move(other.m_allocator))
+        {
+            take(other);
         }
-        else if (condParserIsAlpha(*ctx->cur)) {
-            ctx->curToken.type = CondParserToken_ID;
-            int i = 0;
-            while (condParserIsAlnum(*ctx->cur) && i < (CONDPARSER_ID_LENGTH - 1)) {
-                ctx->curToken.id[i++] = *ctx->cur++;
+
+        basic_program& operator=(basic_program&& other) noexcept(traits::propagate_on_container_move_assignment::value || traits::is_always_equal::value)
+        {
+            if (this == &other) {
+                return *this;
             }
-            ctx->curToken.id[i] = '\0';
+
+            if constexpr (traits::propagate_on_container_move_assignment::value) {
+                release();
+                m_allocator = std::move(other.m_allocator);
+                take(other);
+            }
+            else if (m_allocator == other.m_allocator || other.is_inline()) {
+                release();
+                take(other);
+            }
+            else {
+                // our allocator can't free the other buffer, the code is copied inline or into a buffer of ours
+                int size = other.m_program.size;
+                unsigned char* code = size <= inline_capacity ? m_inline : traits::allocate(m_allocator, (std::size_t)size);
+                release();
+                std::memcpy(code, other.m_program.code, (std::size_t)size);
+                m_program = other.m_program;
+                m_program.code = code;
+                m_program.capacity = code == m_inline ? inline_capacity : size;
+                other.release();
+            }
+            return *this;
         }
-        else {
-            const char ctxCur[2] = { *ctx->cur, '\0' };
-            condParserPrintError(ctx, "Unknown character: ");
-            condParserPrintError(ctx, ctxCur);
-            condParserPrintError(ctx, "\n");
-            ctx->cur++;
 
-            ctx->error = true;
+        basic_program(const basic_program&) = delete;
+        basic_program& operator=(const basic_program&) = delete;
+
+        ~basic_program()
+        {
+            release();
         }
-    }
 
-    static bool condParserParseExpr(CondParserContext* ctx);
+        bool compile(std::string_view expr, const CondParserSymbols& symbols, PFN_condParserError errorFn = nullptr)
+        {
+            // the C API wants a null-terminated expression
+            char stackText[256];
+            scratch heapText(m_allocator, expr.size() < sizeof(stackText) ? 0 : expr.size() + 1);
+            char* text = heapText.data ? reinterpret_cast<char*>(heapText.data) : stackText;
+            std::memcpy(text, expr.data(), expr.size());
+            text[expr.size()] = '\0';
 
-    static bool condParserParsePrimary(CondParserContext* ctx)
+            // compiles next to the current program, which is only replaced on success; an overflow leaves size at
+            // capacity and the attempt is repeated with a larger buffer
+            unsigned char inlineCode[inline_capacity];
+            scratch buffer(m_allocator, 0);
+            CondParserProgram program = {};
+            program.code = inlineCode;
+            program.capacity = inline_capacity;
+
+            // the messages of an attempt are kept until it's known to be the last one
+            std::string messages;
+            error_sink sink(errorFn ? &messages : nullptr);
+            bool compiled;
+            for (;;) {
+                messages.clear();
+                compiled = condParserCompile(text, &symbols, errorFn ? collect_error : nullptr, &program);
+                if (compiled || program.size != program.capacity || program.capacity * 4 > (1 << 20)) {
+                    break;
+                }
+
+                int capacity = program.capacity * 4;
+                unsigned char* code = traits::allocate(m_allocator, (std::size_t)capacity);
+                if (buffer.data) {
+                    traits::deallocate(m_allocator, buffer.data, buffer.size);
+                }
+                buffer.data = code;
+                buffer.size = (std::size_t)capacity;
+                program.code = code;
+                program.capacity = capacity;
+            }
+
+            if (!compiled) {
+                if (errorFn && !messages.empty()) {
+                    errorFn(messages.c_str());
+                }
+                return false;
+            }
+
+            release();
+            m_program = program;
+            if (buffer.data) {
+                // the buffer now belongs to the program
+                buffer.data = nullptr;
+            }
+            else {
+                std::memcpy(m_inline, inlineCode, (std::size_t)program.size);
+                m_program.code = m_inline;
+            }
+            return true;
+        }
+
+        bool execute(const CondParserEnv& env) const
+        {
+            return condParserExecute(&m_program, &env);
+        }
+
+        void execute_batch(const CondParserBatch& batch, uint64_t* results) const
+        {
+            condParserExecuteBatch(&m_program, &batch, results);
+        }
+
+        const CondParserProgram* get() const noexcept
+        {
+            return &m_program;
+        }
+
+        int size() const noexcept
+        {
+            return m_program.size;
+        }
+
+        bool empty() const noexcept
+        {
+            return m_program.size == 0;
+        }
+
+        bool is_inline() const noexcept
+        {
+            return m_program.code == m_inline;
+        }
+
+    private:
+        typedef std::allocator_traits<Allocator> traits;
+
+        // the messages of the compile in flight on this thread
+        static std::string*& pending_messages() noexcept
+        {
+            static thread_local std::string* messages = nullptr;
+            return messages;
+        }
+
+        static void collect_error(const char* message)
+        {
+            if (pending_messages()) {
+                pending_messages()->append(message);
+            }
+        }
+
+        // points pending_messages at a compile's messages, restoring the previous ones for nested compiles
+        struct error_sink
+        {
+            std::string* previous;
+
+            explicit error_sink(std::string* messages) noexcept
+                : previous(pending_messages())
+            {
+                pending_messages() = messages;
+            }
+
+            ~error_sink()
+            {
+                pending_messages() = previous;
+            }
+        };
+
+        // a temporary buffer from the allocator, released on every way out of compile
+        struct scratch
+        {
+            Allocator& allocator;
+            unsigned char* data;
+            std::size_t size;
+
+            scratch(Allocator& owner, std::size_t bytes)
+                : allocator(owner), data(bytes ? traits::allocate(owner, bytes) : nullptr), size(bytes)
+            {
+            }
+
+            ~scratch()
+            {
+                if (data) {
+                    traits::deallocate(allocator, data, size);
+                }
+            }
+        };
+
+        void reset() noexcept
+        {
+            m_program.code = m_inline;
+            m_program.capacity = inline_capacity;
+            m_program.size = 0;
+            m_program.numSlots = 0;
+            m_program.numFields = 0;
+            m_program.maxStack = 0;
+            m_program.verified = false;
+        }
+
+        void release() noexcept
+        {
+            if (!is_inline()) {
+                traits::deallocate(m_allocator, m_program.code, (std::size_t)m_program.capacity);
+            }
+            reset();
+        }
+
+        // inline code is copied, an allocated buffer changes hands
+        void take(basic_program& other) noexcept
+        {
+            m_program = other.m_program;
+            if (other.is_inline()) {
+                std::memcpy(m_inline, other.m_inline, (std::size_t)other.m_program.size);
+                m_program.code = m_inline;
+            }
+            other.reset();
+        }
+
+        CondParserProgram m_program;
+        Allocator m_allocator;
+        unsigned char m_inline[inline_capacity];
+    };
+
+    typedef basic_program<> program;
+}
+
+#endif
+
+#ifdef CONDPARSER_IMPLEMENTATION
+
+#include <stddef.h>
+
+#ifndef CONDPARSER_STRNCMP
+#include <string.h>
+#define CONDPARSER_STRNCMP strncmp
+#endif
+
+#ifndef CONDPARSER_ID_LENGTH
+#define CONDPARSER_ID_LENGTH 32
+#endif
+
+#ifndef CONDPARSER_STACK_SIZE
+#define CONDPARSER_STACK_SIZE 64
+#endif
+
+#ifndef CONDPARSER_MASK_WORDS
+#define CONDPARSER_MASK_WORDS 16
+#endif
+
+#ifndef CONDPARSER_ANALYSIS_SLOTS
+#define CONDPARSER_ANALYSIS_SLOTS 12
+#endif
+
+#if !defined(CONDPARSER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CONDPARSER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__GNUC__) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CONDPARSER_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#elif defined(__SANITIZE_ADDRESS__) && defined(_MSC_VER)
+#define CONDPARSER_NO_ASAN __declspec(no_sanitize_address)
+#elif defined(__SANITIZE_ADDRESS__)
+#define CONDPARSER_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#ifndef CONDPARSER_NO_ASAN
+#define CONDPARSER_NO_ASAN
+#endif
+
+typedef struct
+{
+    CondParserTokenType type;
+    char id[CONDPARSER_ID_LENGTH];
+    int number;
+} CondParserToken;
+
+typedef struct
+{
+    const char* cur;
+    CondParserToken curToken;
+    bool error;
+    bool overflow;                      // the program buffer ran out, even if folding shrank the program since
+    PFN_condParserGetValue getValue;
+    PFN_condParserGetEnum getEnum;
+    PFN_condParserGetNumber getNumber;
+    PFN_condParserError errorFn;
+    const CondParserSymbols* symbols;
+    CondParserProgram* program;
+    int depth;
+    const CondParserTokenSpan* tokens; // next token of a pre-tokenized expression, cur then stays at its start
+    const CondParserStats* stats;       // set when planning, the estimates below describe the last compiled subexpression
+    float probability;
+    float cost;
+} CondParserContext;
+
+// Bytecode of compiled programs. Operands are little-endian, jump offsets are relative to the end of the jump.
+typedef enum
+{
+    CondParserOp_Slot,          // u16 slot: push the value of a slot
+    CondParserOp_Not,           // negate the top of the stack
+    CondParserOp_And,           // pop two values, push their conjunction
+    CondParserOp_Or,            // pop two values, push their disjunction
+    CondParserOp_JumpIfFalse,   // u16 offset: skip forward if the top of the stack is false, keeping it
+    CondParserOp_JumpIfTrue,    // u16 offset: skip forward if the top of the stack is true, keeping it
+    CondParserOp_AtLeast,       // u16 count, u16 numStack, u16 numMasks, numMasks * (u16 word, u64 mask)
+    CondParserOp_AtMost,        // same operands as CondParserOp_AtLeast
+    CondParserOp_Exactly,       // same operands as CondParserOp_AtLeast
+    CondParserOp_In,            // u16 field, u64 mask: push whether the field's value is in the mask
+    CondParserOp_Range,         // u16 field, i32 lo, i32 hi: push whether lo <= the field's value <= hi
+    CondParserOp_False,         // push false, only emitted when a whole expression folds to a constant
+    CondParserOp_True,          // push true, same as CondParserOp_False
+    CondParserOp_Table,         // u16 numSlots (at most 6), numSlots * u16 slot, u64 table: push bit i of the table,
+                                // bit j of i being the value of the j-th slot
+    CondParserOp_Xor,           // pop two values, push whether they differ
+    CondParserOp_Equal,         // pop two values, push whether they are equal
+    CondParserOp_Implies,       // pop b then a, push !a || b
+    CondParserOp_Select         // pop e, t then c, push c ? t : e
+} CondParserOp;
+
+// result of compiling a subexpression: either code that leaves a value on the stack, or a constant
+typedef enum
+{
+    CondParserFold_None,
+    CondParserFold_False,
+    CondParserFold_True
+} CondParserFold;
+
+typedef struct
+{
+    int size;
+    int depth;
+    int maxStack;
+    int numSlots;
+    int numFields;
+} CondParserMark;
+
+// bit-sliced counters of the batch engine, thresholds are at most 16 bits wide
+#define CONDPARSER_COUNT_PLANES 16
+
+// slots of a truth table instruction, whose table fits one word
+#define CONDPARSER_TABLE_SLOTS 6
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    static bool condParserIsSpace(char c)
+    {
+        return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\v') || (c == '\f') || (c == '\r');
+    }
+
+    static bool condParserIsAlpha(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    static bool condParserIsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool condParserIsAlnum(char c)
+    {
+        return condParserIsAlpha(c) || condParserIsDigit(c);
+    }
+
+    // identifiers continue with alphanumerics, or a dot that starts the next namespace component
+    static bool condParserIsIdChar(const char* c)
+    {
+        return condParserIsAlnum(c[0]) || (c[0] == '.' && condParserIsAlpha(c[1]));
+    }
+
+    static int condParserPopcount64(uint64_t x)
+    {
+#if defined(CONDPARSER_POPCOUNT64)
+        return CONDPARSER_POPCOUNT64(x);
+#elif defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(x);
+#else
+        x = x - ((x >> 1) & 0x5555555555555555ull);
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return (int)((x * 0x0101010101010101ull) >> 56);
+#endif
+    }
+
+    static unsigned condParserReadU16(const unsigned char* p)
+    {
+        return (unsigned)p[0] | ((unsigned)p[1] << 8);
+    }
+
+    static uint32_t condParserReadU32(const unsigned char* p)
+    {
+        return (uint32_t)condParserReadU16(p) | ((uint32_t)condParserReadU16(p + 2) << 16);
+    }
+
+    static uint64_t condParserReadU64(const unsigned char* p)
+    {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; i--) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+
+    static void condParserPrintError(const CondParserContext* ctx, const char* msg)
+    {
+        if (ctx->errorFn)
+        {
+            ctx->errorFn(msg);
+        }
+    }
+
+    static void condParserPrintToken(const CondParserContext* ctx)
+    {
+        switch (ctx->curToken.type)
+        {
+        case CondParserToken_ID:
+            condParserPrintError(ctx, "ID [");
+            condParserPrintError(ctx, ctx->curToken.id);
+            condParserPrintError(ctx, "]");
+            break;
+        case CondParserToken_LParen:
+            condParserPrintError(ctx, "LPAREN");
+            break;
+        case CondParserToken_RParen:
+            condParserPrintError(ctx, "RPAREN");
+            break;
+        case CondParserToken_Not:
+            condParserPrintError(ctx, "NOT");
+            break;
+        case CondParserToken_And:
+            condParserPrintError(ctx, "AND");
+            break;
+        case CondParserToken_Or:
+            condParserPrintError(ctx, "OR");
+            break;
+        case CondParserToken_Comma:
+            condParserPrintError(ctx, "COMMA");
+            break;
+        case CondParserToken_Number:
+            condParserPrintError(ctx, "NUMBER");
+            break;
+        case CondParserToken_AtLeast:
+            condParserPrintError(ctx, "ATLEAST");
+            break;
+        case CondParserToken_AtMost:
+            condParserPrintError(ctx, "ATMOST");
+            break;
+        case CondParserToken_Exactly:
+            condParserPrintError(ctx, "EXACTLY");
+            break;
+        case CondParserToken_In:
+            condParserPrintError(ctx, "IN");
+            break;
+        case CondParserToken_True:
+            condParserPrintError(ctx, "TRUE");
+            break;
+        case CondParserToken_False:
+            condParserPrintError(ctx, "FALSE");
+            break;
+        case CondParserToken_Less:
+            condParserPrintError(ctx, "LESS");
+            break;
+        case CondParserToken_LessEqual:
+            condParserPrintError(ctx, "LESS_EQUAL");
+            break;
+        case CondParserToken_Equal:
+            condParserPrintError(ctx, "EQUAL");
+            break;
+        case CondParserToken_NotEqual:
+            condParserPrintError(ctx, "NOT_EQUAL");
+            break;
+        case CondParserToken_GreaterEqual:
+            condParserPrintError(ctx, "GREATER_EQUAL");
+            break;
+        case CondParserToken_Greater:
+            condParserPrintError(ctx, "GREATER");
+            break;
+        case CondParserToken_Xor:
+            condParserPrintError(ctx, "XOR");
+            break;
+        case CondParserToken_Implies:
+            condParserPrintError(ctx, "IMPLIES");
+            break;
+        case CondParserToken_Question:
+            condParserPrintError(ctx, "QUESTION");
+            break;
+        case CondParserToken_Colon:
+            condParserPrintError(ctx, "COLON");
+            break;
+        case CondParserToken_End:
+            condParserPrintError(ctx, "END");
+            break;
+        default:
+            condParserPrintError(ctx, "<<UNKNOWN TOKEN>>");
+            break;
+        }
+    }
+
+    static const struct
+    {
+        const char* name;
+        CondParserTokenType type;
+    } condParserKeywords[] = {
+        { "atleast", CondParserToken_AtLeast },
+        { "atmost", CondParserToken_AtMost },
+        { "exactly", CondParserToken_Exactly },
+        { "in", CondParserToken_In },
+        { "true", CondParserToken_True },
+        { "false", CondParserToken_False }
+    };
+
+    // lexes <, <=, ==, !=, >=, >, ^, ->, ? and :, returns their length or 0
+    static int condParserOperator(const char* p, CondParserTokenType* type)
+    {
+        if ((p[0] == '=' || p[0] == '!') && p[1] == '=') {
+            *type = p[0] == '=' ? CondParserToken_Equal : CondParserToken_NotEqual;
+            return 2;
+        }
+        if (p[0] == '-' && p[1] == '>') {
+            *type = CondParserToken_Implies;
+            return 2;
+        }
+        if (p[0] == '^' || p[0] == '?' || p[0] == ':') {
+            *type = p[0] == '^' ? CondParserToken_Xor : p[0] == '?' ? CondParserToken_Question : CondParserToken_Colon;
+            return 1;
+        }
+        if (p[0] == '<' || p[0] == '>') {
+            bool orEqual = p[1] == '=';
+            *type = p[0] == '<' ? (orEqual ? CondParserToken_LessEqual : CondParserToken_Less) : (orEqual ? CondParserToken_GreaterEqual : CondParserToken_Greater);
+            return orEqual ? 2 : 1;
+        }
+        return 0;
+    }
+
+    // lexes an optionally negative number, returns its end
+    static const char* condParserLexNumber(CondParserContext* ctx, const char* p, int* number)
+    {
+        bool negative = *p == '-';
+        p += negative;
+
+        *number = 0;
+        bool tooLarge = false;
+        for (; condParserIsDigit(*p); p++) {
+            tooLarge = tooLarge || *number > 99999999;
+            *number = tooLarge ? *number : *number * 10 + (*p - '0');
+        }
+
+        if (tooLarge) {
+            condParserPrintError(ctx, "Error: number too large\n");
+            ctx->error = true;
+        }
+        *number = negative ? -*number : *number;
+        return p;
+    }
+
+    static void condParserNextSpan(CondParserContext* ctx)
+    {
+        const CondParserTokenSpan* span = ctx->tokens;
+        ctx->curToken.type = span->type;
+        ctx->curToken.number = span->number;
+
+        if (span->type == CondParserToken_ID) {
+            int length = span->length < CONDPARSER_ID_LENGTH ? span->length : CONDPARSER_ID_LENGTH - 1;
+            for (int i = 0; i < length; i++) {
+                ctx->curToken.id[i] = ctx->cur[span->offset + i];
+            }
+            ctx->curToken.id[length] = '\0';
+
+            if (span->length != length) {
+                condParserPrintError(ctx, "Error: identifier too long: ");
+                condParserPrintError(ctx, ctx->curToken.id);
+                condParserPrintError(ctx, "\n");
+                ctx->error = true;
+            }
+        }
+
+        if (span->type != CondParserToken_End) {
+            ctx->tokens++;
+        }
+    }
+
+    static void condParserNextToken(CondParserContext* ctx)
+    {
+        if (ctx->tokens) {
+            condParserNextSpan(ctx);
+            return;
+        }
+
+        // skip ws
+        while (condParserIsSpace(*ctx->cur)) ctx->cur++;
+
+        if (*ctx->cur == '\0') {
+            ctx->curToken.type = CondParserToken_End;
+        }
+        else if (CONDPARSER_STRNCMP(ctx->cur, "&&", 2) == 0) {
+            ctx->curToken.type = CondParserToken_And;
+            ctx->cur += 2;
+        }
+        else if (CONDPARSER_STRNCMP(ctx->cur, "||", 2) == 0) {
+            ctx->curToken.type = CondParserToken_Or;
+            ctx->cur += 2;
+        }
+        else if (condParserOperator(ctx->cur, &ctx->curToken.type) != 0) {
+            ctx->cur += condParserOperator(ctx->cur, &ctx->curToken.type);
+        }
+        else if (*ctx->cur == '!') {
+            ctx->curToken.type = CondParserToken_Not;
+            ctx->cur++;
+        }
+        else if (*ctx->cur == '(') {
+            ctx->curToken.type = CondParserToken_LParen;
+            ctx->cur++;
+        }
+        else if (*ctx->cur == ')') {
+            ctx->curToken.type = CondParserToken_RParen;
+            ctx->cur++;
+        }
+        else if (*ctx->cur == ',') {
+            ctx->curToken.type = CondParserToken_Comma;
+            ctx->cur++;
+        }
+        else if (condParserIsDigit(*ctx->cur) || (*ctx->cur == '-' && condParserIsDigit(ctx->cur[1]))) {
+            ctx->curToken.type = CondParserToken_Number;
+            ctx->cur = condParserLexNumber(ctx, ctx->cur, &ctx->curToken.number);
+        }
+        else if (condParserIsAlpha(*ctx->cur)) {
+            ctx->curToken.type = CondParserToken_ID;
+            int i = 0;
+            while (condParserIsIdChar(ctx->cur) && i < (CONDPARSER_ID_LENGTH - 1)) {
+                ctx->curToken.id[i++] = *ctx->cur++;
+            }
+            ctx->curToken.id[i] = '\0';
+
+            // the rest of a long identifier is consumed so it isn't lexed as more tokens
+            if (condParserIsIdChar(ctx->cur)) {
+                while (condParserIsIdChar(ctx->cur)) ctx->cur++;
+                condParserPrintError(ctx, "Error: identifier too long: ");
+                condParserPrintError(ctx, ctx->curToken.id);
+                condParserPrintError(ctx, "\n");
+                ctx->error = true;
+            }
+
+            for (int k = 0; k < (int)(sizeof(condParserKeywords) / sizeof(condParserKeywords[0])); k++) {
+                if (CONDPARSER_STRNCMP(ctx->curToken.id, condParserKeywords[k].name, CONDPARSER_ID_LENGTH) == 0) {
+                    ctx->curToken.type = condParserKeywords[k].type;
+                    break;
+                }
+            }
+        }
+        else {
+            const char ctxCur[2] = { *ctx->cur, '\0' };
+            condParserPrintError(ctx, "Unknown character: ");
+            condParserPrintError(ctx, ctxCur);
+            condParserPrintError(ctx, "\n");
+            ctx->cur++;
+
+            ctx->error = true;
+        }
+    }
+
+    // returns the value of a constant token (true, false, 1 or 0), or -1 if the token isn't a constant
+    static int condParserConstant(const CondParserToken* token)
+    {
+        if (token->type == CondParserToken_True || token->type == CondParserToken_False) {
+            return token->type == CondParserToken_True;
+        }
+        if (token->type == CondParserToken_Number && token->number >= 0 && token->number <= 1) {
+            return token->number;
+        }
+        return -1;
+    }
+
+    static bool condParserIsStructural(char c)
+    {
+        return c == '(' || c == ')' || c == ',' || c == '|' || c == '?' || c == ':' || c == '-' || c == '\0';
+    }
+
+    // returns the first '(', ')', ',', '|', '?', ':', '-' or terminator at or after p
+    // the aligned loads may read past the terminator, but never into the next page
+    CONDPARSER_NO_ASAN static const char* condParserFindStructural(const char* p)
+    {
+#ifdef CONDPARSER_SSE2
+        while (((uintptr_t)p & 15) != 0) {
+            if (condParserIsStructural(*p)) {
+                return p;
+            }
+            p++;
+        }
+
+        const __m128i lparen = _mm_set1_epi8('(');
+        const __m128i rparen = _mm_set1_epi8(')');
+        const __m128i comma = _mm_set1_epi8(',');
+        const __m128i bar = _mm_set1_epi8('|');
+        const __m128i question = _mm_set1_epi8('?');
+        const __m128i colon = _mm_set1_epi8(':');
+        const __m128i minus = _mm_set1_epi8('-');
+        const __m128i zero = _mm_setzero_si128();
+
+        for (;;) {
+            __m128i chunk = _mm_load_si128((const __m128i*)p);
+            __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, lparen), _mm_cmpeq_epi8(chunk, rparen)),
+                _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, bar)), _mm_cmpeq_epi8(chunk, zero)));
+            hits = _mm_or_si128(hits, _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, question), _mm_cmpeq_epi8(chunk, colon)),
+                _mm_cmpeq_epi8(chunk, minus)));
+
+            unsigned mask = (unsigned)_mm_movemask_epi8(hits);
+            if (mask != 0) {
+                return p + condParserPopcount64((mask & (0 - mask)) - 1);
+            }
+            p += 16;
+        }
+#else
+        while (!condParserIsStructural(*p)) p++;
+        return p;
+#endif
+    }
+
+    // where condParserSkip stops, each level also stopping where the ones before it do
+    typedef enum
+    {
+        CondParserSkip_Group,       // the ')' closing the enclosing group
+        CondParserSkip_Branch,      // a ',' or a ':' not matching a skipped '?'
+        CondParserSkip_Implication, // a '?' or any ':'
+        CondParserSkip_Or,          // a '->'
+        CondParserSkip_And          // a '||'
+    } CondParserSkipLevel;
+
+    // skips the remaining operands of a decided chain or the untaken branch of a select without lexing them,
+    // stops before the first token at the same level that ends it
+    static void condParserSkip(CondParserContext* ctx, CondParserSkipLevel level)
+    {
+        const char* p = ctx->cur;
+        int depth = 0;
+        int branches = 0;
+
+        for (;;) {
+            p = condParserFindStructural(p);
+            if (*p == '\0') {
+                break;
+            }
+            else if (*p == '(') {
+                depth++;
+            }
+            else if (*p == ')') {
+                if (depth == 0) {
+                    break;
+                }
+                depth--;
+            }
+            else if (depth == 0 && level >= CondParserSkip_Branch) {
+                if (*p == ',' || (*p == '?' && level >= CondParserSkip_Implication) || (*p == ':' && branches == 0)) {
+                    break;
+                }
+                if ((*p == '-' && p[1] == '>' && level >= CondParserSkip_Or) || (*p == '|' && p[1] == '|' && level >= CondParserSkip_And)) {
+                    break;
+                }
+                branches += (*p == '?') - (*p == ':');
+            }
+            p++;
+        }
+
+        ctx->cur = p;
+        condParserNextToken(ctx);
+    }
+
+    // character classes whose runs the tokenizer scans in blocks
+    typedef enum
+    {
+        CondParserClass_Space,
+        CondParserClass_Id,
+        CondParserClass_Digit
+    } CondParserClass;
+
+#ifdef CONDPARSER_SSE2
+    // (c - lo) < n as unsigned bytes, using a signed compare of values biased by -128
+    static __m128i condParserInRange(__m128i c, int lo, int n)
+    {
+        return _mm_cmplt_epi8(_mm_add_epi8(c, _mm_set1_epi8((char)(128 - lo))), _mm_set1_epi8((char)(n - 128)));
+    }
+
+    // mask of the bytes of the aligned block at p that belong to a class
+    // a dot in the last byte counts as an identifier character, the caller checks the byte after it
+    CONDPARSER_NO_ASAN static unsigned condParserClassifyBlock(const char* p, CondParserClass cls)
+    {
+        __m128i chunk = _mm_load_si128((const __m128i*)p);
+        __m128i digit = condParserInRange(chunk, '0', 10);
+
+        if (cls == CondParserClass_Space) {
+            return (unsigned)_mm_movemask_epi8(_mm_or_si128(condParserInRange(chunk, '\t', 5), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '))));
+        }
+        if (cls == CondParserClass_Digit) {
+            return (unsigned)_mm_movemask_epi8(digit);
+        }
+
+        unsigned alpha = (unsigned)_mm_movemask_epi8(condParserInRange(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), 'a', 26));
+        unsigned dot = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('.')));
+        return alpha | (unsigned)_mm_movemask_epi8(digit) | (dot & ((alpha >> 1) | 0x8000));
+    }
+#else
+    static bool condParserIsClass(const char* p, CondParserClass cls)
+    {
+        switch (cls)
+        {
+        case CondParserClass_Space:
+            return condParserIsSpace(*p);
+        case CondParserClass_Digit:
+            return condParserIsDigit(*p);
+        default:
+            return condParserIsIdChar(p);
+        }
+    }
+#endif
+
+    // returns the end of the run of characters of a class starting at p, classifying 16 bytes per step
+    static const char* condParserSpanEnd(const char* p, CondParserClass cls)
+    {
+#ifdef CONDPARSER_SSE2
+        const char* block = (const char*)((uintptr_t)p & ~(uintptr_t)15);
+        unsigned outside = ~condParserClassifyBlock(block, cls) & (0xffffu << (p - block));
+
+        for (;;) {
+            outside &= 0xffff;
+            if (outside != 0) {
+                return block + condParserPopcount64((outside & (0 - outside)) - 1);
+            }
+
+            // the run covers the whole block, so the byte after it is part of the string
+            if (cls == CondParserClass_Id && block[15] == '.' && !condParserIsAlpha(block[16])) {
+                return block + 15;
+            }
+
+            block += 16;
+            outside = ~condParserClassifyBlock(block, cls);
+        }
+#else
+        while (condParserIsClass(p, cls)) p++;
+        return p;
+#endif
+    }
+
+    uint32_t condParserHash(const char* id, int length)
+    {
+        // multiply-xorshift over 8 bytes per step, the length is mixed in so a zero tail doesn't collide
+        const unsigned char* p = (const unsigned char*)id;
+        uint64_t hash = 0x9e3779b97f4a7c15ull ^ (uint64_t)length;
+        int i = 0;
+        for (; i + 8 <= length; i += 8) {
+            hash = (hash ^ condParserReadU64(p + i)) * 0xff51afd7ed558ccdull;
+            hash ^= hash >> 32;
+        }
+
+        uint64_t tail = 0;
+        for (int k = length - 1; k >= i; k--) {
+            tail = (tail << 8) | p[k];
+        }
+        hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 29;
+        return (uint32_t)hash ^ (uint32_t)(hash >> 32);
+    }
+
+    int condParserTokenize(const char* expr, CondParserTokenSpan* tokens, int capacity, PFN_condParserError errorFn)
+    {
+        CondParserContext ctx;
+        ctx.errorFn = errorFn;
+        ctx.error = false;
+
+        const char* p = expr;
+        int numTokens = 0;
+
+        for (;;) {
+            // single spaces between tokens are the common case, so only longer runs are scanned in blocks
+            if (condParserIsSpace(*p)) {
+                p = condParserIsSpace(p[1]) ? condParserSpanEnd(p + 1, CondParserClass_Space) : p + 1;
+            }
+
+            if (numTokens == capacity) {
+                condParserPrintError(&ctx, "Error: token buffer too small\n");
+                return -1;
+            }
+
+            CondParserTokenSpan* token = &tokens[numTokens++];
+            const char* start = p;
+            token->offset = (int)(p - expr);
+            token->number = 0;
+            token->hash = 0;
+
+            if (*p == '\0') {
+                token->type = CondParserToken_End;
+            }
+            else if ((p[0] == '&' && p[1] == '&') || (p[0] == '|' && p[1] == '|')) {
+                token->type = p[0] == '&' ? CondParserToken_And : CondParserToken_Or;
+                p += 2;
+            }
+            else if (condParserOperator(p, &token->type) != 0) {
+                p += condParserOperator(p, &token->type);
+            }
+            else if (*p == '!' || *p == '(' || *p == ')' || *p == ',') {
+                token->type = *p == '!' ? CondParserToken_Not : *p == '(' ? CondParserToken_LParen : *p == ')' ? CondParserToken_RParen : CondParserToken_Comma;
+                p++;
+            }
+            else if (condParserIsDigit(*p) || (*p == '-' && condParserIsDigit(p[1]))) {
+                token->type = CondParserToken_Number;
+                condParserLexNumber(&ctx, p, &token->number);
+                p = condParserSpanEnd(p + (*p == '-'), CondParserClass_Digit);
+            }
+            else if (condParserIsAlpha(*p)) {
+                token->type = CondParserToken_ID;
+                p = condParserSpanEnd(p, CondParserClass_Id);
+                token->hash = condParserHash(start, (int)(p - start));
+
+                // keywords are at most 7 characters long
+                for (int k = 0; p - start <= 7 && k < (int)(sizeof(condParserKeywords) / sizeof(condParserKeywords[0])); k++) {
+                    const char* name = condParserKeywords[k].name;
+                    if (CONDPARSER_STRNCMP(start, name, p - start) == 0 && name[p - start] == '\0') {
+                        token->type = condParserKeywords[k].type;
+                        break;
+                    }
+                }
+            }
+            else {
+                const char unknown[2] = { *p, '\0' };
+                condParserPrintError(&ctx, "Unknown character: ");
+                condParserPrintError(&ctx, unknown);
+                condParserPrintError(&ctx, "\n");
+                ctx.error = true;
+                numTokens--;
+                p++;
+                continue;
+            }
+
+            token->length = (int)(p - start);
+            if (token->type == CondParserToken_End) {
+                break;
+            }
+        }
+
+        return ctx.error ? -1 : numTokens;
+    }
+
+    static CondParserTokenType condParserPeekToken(const CondParserContext* ctx)
+    {
+        CondParserContext peek = *ctx;
+        peek.errorFn = NULL; // errors are reported once the token is actually consumed
+        condParserNextToken(&peek);
+        return peek.curToken.type;
+    }
+
+    static bool condParserExpect(CondParserContext* ctx, CondParserTokenType type, const char* what)
+    {
+        if (ctx->curToken.type != type) {
+            condParserPrintError(ctx, "Error: expected ");
+            condParserPrintError(ctx, what);
+            condParserPrintError(ctx, ", found: ");
+            condParserPrintToken(ctx);
+            condParserPrintError(ctx, "\n");
+            ctx->error = true;
+            return false;
+        }
+        condParserNextToken(ctx);
+        return true;
+    }
+
+    static CondParserOp condParserThresholdOp(CondParserTokenType type)
+    {
+        switch (type)
+        {
+        case CondParserToken_AtMost:
+            return CondParserOp_AtMost;
+        case CondParserToken_Exactly:
+            return CondParserOp_Exactly;
+        default:
+            return CondParserOp_AtLeast;
+        }
+    }
+
+    static bool condParserThresholdHolds(unsigned op, unsigned numTrue, unsigned count)
+    {
+        switch (op)
+        {
+        case CondParserOp_AtMost:
+            return numTrue <= count;
+        case CondParserOp_Exactly:
+            return numTrue == count;
+        default:
+            return numTrue >= count;
+        }
+    }
+
+    // parses "atleast(N" and friends, returns N or -1 on error
+    static int condParserParseThresholdCount(CondParserContext* ctx)
+    {
+        condParserNextToken(ctx); // consume keyword
+
+        if (!condParserExpect(ctx, CondParserToken_LParen, "'('")) {
+            return -1;
+        }
+
+        int count = ctx->curToken.number;
+        if (!condParserExpect(ctx, CondParserToken_Number, "threshold count")) {
+            return -1;
+        }
+
+        if (count < 0 || count > 0xffff) {
+            condParserPrintError(ctx, count < 0 ? "Error: negative threshold count\n" : "Error: threshold count too large\n");
+            ctx->error = true;
+            return -1;
+        }
+
+        return count;
+    }
+
+    static bool condParserIsComparison(CondParserTokenType type)
+    {
+        return type >= CondParserToken_Less && type <= CondParserToken_Greater;
+    }
+
+    // an identifier compared to a number is an integer comparison, "a == b" and "a != b" compare booleans
+    static bool condParserIsCompare(const CondParserContext* ctx)
+    {
+        CondParserTokenType type = ctx->curToken.type;
+        if (type == CondParserToken_Equal || type == CondParserToken_NotEqual) {
+            return condParserPeekToken(ctx) == CondParserToken_Number;
+        }
+        return condParserIsComparison(type);
+    }
+
+    // parses "< N" and friends into the range of values lo..hi they accept
+    static bool condParserParseComparison(CondParserContext* ctx, int32_t* lo, int32_t* hi)
+    {
+        CondParserTokenType type = ctx->curToken.type;
+        condParserNextToken(ctx); // consume the operator
+
+        int number = ctx->curToken.number;
+        if (!condParserExpect(ctx, CondParserToken_Number, "number")) {
+            return false;
+        }
+
+        // numbers have at most 9 digits, so N - 1 and N + 1 don't overflow
+        // != accepts the wrapping range N + 1..N - 1, i.e. everything but N
+        if (type == CondParserToken_NotEqual) {
+            *lo = number + 1;
+            *hi = number - 1;
+            return true;
+        }
+        bool below = type == CondParserToken_Less || type == CondParserToken_LessEqual;
+        bool above = type == CondParserToken_Greater || type == CondParserToken_GreaterEqual;
+        *lo = below ? INT32_MIN : type == CondParserToken_Greater ? number + 1 : number;
+        *hi = above ? INT32_MAX : type == CondParserToken_Less ? number - 1 : number;
+        return true;
+    }
+
+    static bool condParserRangeHolds(int32_t value, uint32_t lo, uint32_t hi)
+    {
+        return (uint32_t)value - lo <= hi - lo;
+    }
+
+    static bool condParserParseExpr(CondParserContext* ctx);
+
+    static bool condParserParseThreshold(CondParserContext* ctx)
+    {
+        CondParserOp op = condParserThresholdOp(ctx->curToken.type);
+
+        int count = condParserParseThresholdCount(ctx);
+        if (count < 0) {
+            return 0;
+        }
+
+        unsigned numTrue = 0;
+        while (ctx->curToken.type == CondParserToken_Comma) {
+            // once reached, at least N stays true and at most / exactly N stay false
+            if ((op == CondParserOp_AtLeast && numTrue >= (unsigned)count) || numTrue > (unsigned)count) {
+                condParserSkip(ctx, CondParserSkip_Group);
+                break;
+            }
+
+            condParserNextToken(ctx); // consume ','
+            if (condParserParseExpr(ctx)) {
+                numTrue++;
+            }
+        }
+
+        if (!condParserExpect(ctx, CondParserToken_RParen, "')'")) {
+            return 0;
+        }
+
+        return condParserThresholdHolds(op, numTrue, (unsigned)count);
+    }
+
+    static bool condParserParseMembership(CondParserContext* ctx, const char* id)
+    {
+        condParserNextToken(ctx); // consume 'in'
+
+        const char* current = NULL;
+        if (ctx->getEnum) {
+            current = ctx->getEnum(id);
+        }
+        else {
+            condParserPrintError(ctx, "Error: no getEnum callback for: ");
+            condParserPrintError(ctx, id);
+            condParserPrintError(ctx, "\n");
+            ctx->error = true;
+        }
+
+        if (!condParserExpect(ctx, CondParserToken_LParen, "'('")) {
+            return 0;
+        }
+
+        bool value = false;
+        for (;;) {
+            if (ctx->curToken.type != CondParserToken_ID) {
+                return condParserExpect(ctx, CondParserToken_ID, "enumerator");
+            }
+
+            if (current && CONDPARSER_STRNCMP(current, ctx->curToken.id, CONDPARSER_ID_LENGTH) == 0) {
+                value = true;
+            }
+            condParserNextToken(ctx);
+
+            if (ctx->curToken.type != CondParserToken_Comma) {
+                break;
+            }
+            condParserNextToken(ctx); // consume ','
+        }
+
+        if (!condParserExpect(ctx, CondParserToken_RParen, "')'")) {
+            return 0;
+        }
+
+        return value;
+    }
+
+    static bool condParserParseCompare(CondParserContext* ctx, const char* id)
+    {
+        int32_t value = 0;
+        if (ctx->getNumber) {
+            value = ctx->getNumber(id);
+        }
+        else {
+            condParserPrintError(ctx, "Error: no getNumber callback for: ");
+            condParserPrintError(ctx, id);
+            condParserPrintError(ctx, "\n");
+            ctx->error = true;
+        }
+
+        int32_t lo, hi;
+        if (!condParserParseComparison(ctx, &lo, &hi)) {
+            return 0;
+        }
+        return condParserRangeHolds(value, (uint32_t)lo, (uint32_t)hi);
+    }
+
+    static bool condParserParsePrimary(CondParserContext* ctx)
+    {
+        if (ctx->curToken.type == CondParserToken_ID) {
+            const CondParserToken id = ctx->curToken;
+            condParserNextToken(ctx);
+
+            if (ctx->curToken.type == CondParserToken_In) {
+                return condParserParseMembership(ctx, id.id);
+            }
+            if (condParserIsCompare(ctx)) {
+                return condParserParseCompare(ctx, id.id);
+            }
+            return ctx->getValue(id.id);
+        }
+        else if (condParserConstant(&ctx->curToken) >= 0) {
+            bool value = condParserConstant(&ctx->curToken) == 1;
+            condParserNextToken(ctx);
+            return value;
+        }
+        else if (ctx->curToken.type == CondParserToken_LParen) {
+            condParserNextToken(ctx); // consume '('
+            bool value = condParserParseExpr(ctx);
+
+            if (ctx->curToken.type != CondParserToken_RParen) {
+                condParserPrintError(ctx, "Error: expected ')', found: ");
+                condParserPrintToken(ctx);
+                condParserPrintError(ctx, "\n");
+                return 0;
+            }
+            condParserNextToken(ctx); // consume ')'
+            return value;
+        }
+        else if (ctx->curToken.type == CondParserToken_AtLeast || ctx->curToken.type == CondParserToken_AtMost || ctx->curToken.type == CondParserToken_Exactly) {
+            return condParserParseThreshold(ctx);
+        }
+        else {
+            condParserPrintError(ctx, "Error: expected identifier or '('\n");
+            return 0;
+        }
+    }
+
+    static bool condParserParseNot(CondParserContext* ctx)
+    {
+        int notCount = 0;
+
+        // count nots
+        while (ctx->curToken.type == CondParserToken_Not)
+        {
+            notCount++;
+            condParserNextToken(ctx);
+        }
+
+        bool res = condParserParsePrimary(ctx);
+
+        // negate if odd
+        if (notCount % 2 != 0)
+        {
+            res = !res;
+        }
+
+        return res;
+    }
+
+    static bool condParserParseEquality(CondParserContext* ctx)
+    {
+        bool value = condParserParseNot(ctx);
+        while (ctx->curToken.type == CondParserToken_Equal || ctx->curToken.type == CondParserToken_NotEqual) {
+            bool equal = ctx->curToken.type == CondParserToken_Equal;
+            condParserNextToken(ctx);
+
+            bool res = condParserParseNot(ctx);
+            value = (value == res) == equal;
+        }
+        return value;
+    }
+
+    static bool condParserParseXor(CondParserContext* ctx)
+    {
+        bool value = condParserParseEquality(ctx);
+        while (ctx->curToken.type == CondParserToken_Xor) {
+            condParserNextToken(ctx);
+
+            bool res = condParserParseEquality(ctx);
+            value = value != res;
+        }
+        return value;
+    }
+
+    static bool condParserParseAnd(CondParserContext* ctx)
+    {
+        bool value = condParserParseXor(ctx);
+        while (ctx->curToken.type == CondParserToken_And) {
+            if (!value) {
+                condParserSkip(ctx, CondParserSkip_And);
+                break;
+            }
+
+            condParserNextToken(ctx);
+            bool res = condParserParseXor(ctx);
+
+            value = value && res;
+        }
+        return value;
+    }
+
+    static bool condParserParseOr(CondParserContext* ctx)
+    {
+        bool value = condParserParseAnd(ctx);
+        while (ctx->curToken.type == CondParserToken_Or) {
+            if (value) {
+                condParserSkip(ctx, CondParserSkip_Or);
+                break;
+            }
+
+            condParserNextToken(ctx);
+
+            bool res = condParserParseAnd(ctx);
+            value = value || res;
+        }
+
+        return value;
+    }
+
+    // a -> b -> c is a -> (b -> c), a false premise skips the rest
+    static bool condParserParseImplies(CondParserContext* ctx)
+    {
+        bool value = condParserParseOr(ctx);
+        if (ctx->curToken.type != CondParserToken_Implies) {
+            return value;
+        }
+
+        if (!value) {
+            condParserSkip(ctx, CondParserSkip_Implication);
+            return true;
+        }
+
+        condParserNextToken(ctx);
+        return condParserParseImplies(ctx);
+    }
+
+    // c ? a : b, only the taken branch is evaluated
+    static bool condParserParseSelect(CondParserContext* ctx)
+    {
+        bool value = condParserParseImplies(ctx);
+        if (ctx->curToken.type != CondParserToken_Question) {
+            return value;
+        }
+
+        if (!value) {
+            condParserSkip(ctx, CondParserSkip_Branch);
+            if (!condParserExpect(ctx, CondParserToken_Colon, "':'")) {
+                return 0;
+            }
+            return condParserParseSelect(ctx);
+        }
+
+        condParserNextToken(ctx); // consume '?'
+        value = condParserParseSelect(ctx);
+        if (ctx->curToken.type != CondParserToken_Colon) {
+            condParserExpect(ctx, CondParserToken_Colon, "':'");
+            return 0;
+        }
+        condParserSkip(ctx, CondParserSkip_Branch);
+        return value;
+    }
+
+    static bool condParserParseExpr(CondParserContext* ctx)
+    {
+        bool res = condParserParseSelect(ctx);
+        return res;
+    }
+
+    bool condParserEvaluateEx(const char* expr, const CondParserCallbacks* callbacks)
+    {
+        CondParserContext ctx;
+        ctx.cur = expr;
+        ctx.error = false;
+        ctx.overflow = false;
+        ctx.getValue = callbacks->getValue;
+        ctx.getEnum = callbacks->getEnum;
+        ctx.getNumber = callbacks->getNumber;
+        ctx.errorFn = callbacks->errorFn;
+        ctx.symbols = NULL;
+        ctx.program = NULL;
+        ctx.depth = 0;
+        ctx.tokens = NULL;
+        ctx.stats = NULL;
+        ctx.probability = 0;
+        ctx.cost = 0;
+
+        condParserNextToken(&ctx);
+
+        return condParserParseExpr(&ctx);
+    }
+
+    bool condParserEvaluate(const char* expr, PFN_condParserGetValue getValue, PFN_condParserError errorFn)
+    {
+        CondParserCallbacks callbacks;
+        callbacks.getValue = getValue;
+        callbacks.getEnum = NULL;
+        callbacks.getNumber = NULL;
+        callbacks.errorFn = errorFn;
+
+        return condParserEvaluateEx(expr, &callbacks);
+    }
+
+    static void condParserEmit(CondParserContext* ctx, unsigned value)
+    {
+        CondParserProgram* program = ctx->program;
+        if (program->size >= program->capacity) {
+            if (!ctx->error) {
+                condParserPrintError(ctx, "Error: program buffer too small\n");
+            }
+            ctx->error = true;
+            ctx->overflow = true;
+            return;
+        }
+        program->code[program->size++] = (unsigned char)value;
+    }
+
+    static void condParserEmitU16(CondParserContext* ctx, unsigned value)
+    {
+        condParserEmit(ctx, value & 0xff);
+        condParserEmit(ctx, (value >> 8) & 0xff);
+    }
+
+    static void condParserEmitU32(CondParserContext* ctx, uint32_t value)
+    {
+        condParserEmitU16(ctx, value & 0xffff);
+        condParserEmitU16(ctx, value >> 16);
+    }
+
+    static void condParserEmitU64(CondParserContext* ctx, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++) {
+            condParserEmit(ctx, (unsigned)(value >> (i * 8)) & 0xff);
+        }
+    }
+
+    static void condParserAdjustDepth(CondParserContext* ctx, int delta)
+    {
+        ctx->depth += delta;
+        if (ctx->depth > ctx->program->maxStack) {
+            ctx->program->maxStack = ctx->depth;
+        }
+    }
+
+    // emits a jump with a placeholder offset, returns the position the offset is relative to
+    static int condParserEmitJump(CondParserContext* ctx, CondParserOp op)
+    {
+        condParserEmit(ctx, op);
+        condParserEmitU16(ctx, 0);
+        return ctx->program->size;
+    }
+
+    static void condParserPatchJump(CondParserContext* ctx, int from)
+    {
+        if (ctx->error) {
+            return;
+        }
+
+        int offset = ctx->program->size - from;
+        if (offset > 0xffff) {
+            condParserPrintError(ctx, "Error: expression too large\n");
+            ctx->error = true;
+            return;
+        }
+
+        ctx->program->code[from - 2] = (unsigned char)(offset & 0xff);
+        ctx->program->code[from - 1] = (unsigned char)(offset >> 8);
+    }
+
+    static int condParserResolveSlot(CondParserContext* ctx, const char* id)
+    {
+        int slot = -1;
+        if (ctx->symbols->getSlot) {
+            slot = ctx->symbols->getSlot(id);
+        }
+        else if (ctx->symbols->table) {
+            slot = condParserSymbolTableSlot(ctx->symbols->table, id);
+        }
+        else if (ctx->symbols->interner) {
+            int length = 0;
+            while (id[length] != '\0') length++;
+            slot = condParserIntern(ctx->symbols->interner, id, length);
+        }
+
+        if (slot < 0 || slot > 0xffff) {
+            condParserPrintError(ctx, "Error: unknown identifier: ");
+            condParserPrintError(ctx, id);
+            condParserPrintError(ctx, "\n");
+            ctx->error = true;
+            return 0;
+        }
+
+        if (slot >= ctx->program->numSlots) {
+            ctx->program->numSlots = slot + 1;
+        }
+        return slot;
+    }
+
+    static void condParserEmitSlot(CondParserContext* ctx, int slot)
+    {
+        condParserEmit(ctx, CondParserOp_Slot);
+        condParserEmitU16(ctx, (unsigned)slot);
+        condParserAdjustDepth(ctx, 1);
+    }
+
+    // adds a slot to the masks of a threshold, fails on duplicates and when out of mask words
+    static bool condParserAddMask(unsigned* words, uint64_t* masks, int* numMasks, int slot)
+    {
+        unsigned word = (unsigned)slot >> 6;
+        uint64_t bit = 1ull << (slot & 63);
+
+        for (int i = 0; i < *numMasks; i++) {
+            if (words[i] == word) {
+                if (masks[i] & bit) {
+                    return false;
+                }
+                masks[i] |= bit;
+                return true;
+            }
+        }
+
+        if (*numMasks == CONDPARSER_MASK_WORDS) {
+            return false;
+        }
+
+        words[*numMasks] = word;
+        masks[*numMasks] = bit;
+        (*numMasks)++;
+        return true;
+    }
+
+    static CondParserMark condParserMark(const CondParserContext* ctx)
+    {
+        CondParserMark mark;
+        mark.size = ctx->program->size;
+        mark.depth = ctx->depth;
+        mark.maxStack = ctx->program->maxStack;
+        mark.numSlots = ctx->program->numSlots;
+        mark.numFields = ctx->program->numFields;
+        return mark;
+    }
+
+    // drops code emitted since a mark, used when a subexpression folds to a constant
+    static void condParserTruncate(CondParserContext* ctx, const CondParserMark* mark)
+    {
+        if (ctx->program->size > mark->size) {
+            ctx->program->size = mark->size;
+        }
+        ctx->depth = mark->depth;
+        ctx->program->maxStack = mark->maxStack;
+        ctx->program->numSlots = mark->numSlots;
+        ctx->program->numFields = mark->numFields;
+    }
+
+    static void condParserEstimate(CondParserContext* ctx, float probability, float cost)
+    {
+        ctx->probability = probability;
+        ctx->cost = cost;
+    }
+
+    static void condParserEstimateSlot(CondParserContext* ctx, int slot)
+    {
+        const CondParserStats* stats = ctx->stats;
+        if (stats && slot < stats->numSlots) {
+            condParserEstimate(ctx, stats->probability[slot], stats->cost[slot] + stats->instructionCost);
+        }
+        else if (stats) {
+            condParserEstimate(ctx, 0.5f, 1 + stats->instructionCost);
+        }
+    }
+
+    // adds an operand to the distribution of the number of true threshold operands, the last state counting all
+    // numbers above the threshold
+    static void condParserAddOperand(float* dist, int count, float probability)
+    {
+        dist[count + 1] += dist[count] * probability;
+        for (int i = count; i > 0; i--) {
+            dist[i] = dist[i] * (1 - probability) + dist[i - 1] * probability;
+        }
+        dist[0] *= 1 - probability;
+    }
+
+    static CondParserFold condParserCompileExpr(CondParserContext* ctx);
+
+    static CondParserFold condParserCompileThreshold(CondParserContext* ctx)
+    {
+        CondParserOp op = condParserThresholdOp(ctx->curToken.type);
+        CondParserMark start = condParserMark(ctx);
+
+        int count = condParserParseThresholdCount(ctx);
+        if (count < 0) {
+            return CondParserFold_None;
+        }
+
+        unsigned words[CONDPARSER_MASK_WORDS];
+        uint64_t masks[CONDPARSER_MASK_WORDS];
+        int numMasks = 0;
+        int numStack = 0;
+        int numConstant = 0;
+
+        // planning estimates: all operands are evaluated, the count is distributed as a sum of independent operands
+        float dist[CONDPARSER_STACK_SIZE + 2] = { 1 };
+        bool estimated = ctx->stats && count <= CONDPARSER_STACK_SIZE;
+        float cost = 0;
+
+        while (ctx->curToken.type == CondParserToken_Comma) {
+            condParserNextToken(ctx); // consume ','
+
+            CondParserTokenType next = condParserPeekToken(ctx);
+            if (ctx->curToken.type == CondParserToken_ID && (next == CondParserToken_Comma || next == CondParserToken_RParen)) {
+                // plain identifiers are counted through a mask instead of the stack
+                int slot = condParserResolveSlot(ctx, ctx->curToken.id);
+                if (!condParserAddMask(words, masks, &numMasks, slot)) {
+                    condParserEmitSlot(ctx, slot);
+                    numStack++;
+                }
+                condParserEstimateSlot(ctx, slot);
+                condParserNextToken(ctx);
+            }
+            else {
+                CondParserFold operand = condParserCompileExpr(ctx);
+                if (operand == CondParserFold_None) {
+                    numStack++;
+                }
+                else if (operand == CondParserFold_True) {
+                    numConstant++;
+                }
+            }
+
+            if (estimated) {
+                condParserAddOperand(dist, count, ctx->probability);
+                cost += ctx->cost;
+            }
+        }
+
+        if (ctx->stats) {
+            float atMost = 0;
+            for (int i = 0; estimated && i <= count; i++) {
+                atMost += dist[i];
+            }
+
+            float probability = 0.5f;
+            if (estimated) {
+                probability = op == CondParserOp_AtMost ? atMost : op == CondParserOp_Exactly ? dist[count] : 1 - atMost + dist[count];
+            }
+            condParserEstimate(ctx, probability, cost + ctx->stats->instructionCost);
+        }
+
+        if (!condParserExpect(ctx, CondParserToken_RParen, "')'")) {
+            return CondParserFold_None;
+        }
+
+        // constant operands only shift the count
+        int remaining = count - numConstant;
+        int numVariable = numStack;
+        for (int i = 0; i < numMasks; i++) {
+            numVariable += condParserPopcount64(masks[i]);
+        }
+
+        bool folded = false;
+        bool value = false;
+        if (numStack == 0 && numMasks == 0) {
+            folded = true;
+            value = condParserThresholdHolds(op, (unsigned)numConstant, (unsigned)count);
+        }
+        else if (remaining < 0 || (remaining == 0 && op == CondParserOp_AtLeast)) {
+            folded = true;
+            value = op == CondParserOp_AtLeast;
+        }
+        else if (remaining > numVariable || (remaining == numVariable && op == CondParserOp_AtMost)) {
+            // more than the operands can reach, or all of them at most
+            folded = true;
+            value = op == CondParserOp_AtMost;
+        }
+
+        if (folded) {
+            condParserTruncate(ctx, &start);
+            return value ? CondParserFold_True : CondParserFold_False;
+        }
+
+        condParserEmit(ctx, op);
+        condParserEmitU16(ctx, (unsigned)remaining);
+        condParserEmitU16(ctx, (unsigned)numStack);
+        condParserEmitU16(ctx, (unsigned)numMasks);
+        for (int i = 0; i < numMasks; i++) {
+            condParserEmitU16(ctx, words[i]);
+            condParserEmitU64(ctx, masks[i]);
+        }
+        condParserAdjustDepth(ctx, 1 - numStack);
+        return CondParserFold_None;
+    }
+
+    static int condParserResolveField(CondParserContext* ctx, const char* id)
+    {
+        int field = ctx->symbols->getField ? ctx->symbols->getField(id) : -1;
+        if (field < 0 || field > 0xffff) {
+            condParserPrintError(ctx, "Error: unknown field: ");
+            condParserPrintError(ctx, id);
+            condParserPrintError(ctx, "\n");
+            ctx->error = true;
+            return 0;
+        }
+
+        if (field >= ctx->program->numFields) {
+            ctx->program->numFields = field + 1;
+        }
+        return field;
+    }
+
+    static void condParserCompileMembership(CondParserContext* ctx, const char* id)
+    {
+        int field = condParserResolveField(ctx, id);
+        condParserNextToken(ctx); // consume 'in'
+
+        if (!condParserExpect(ctx, CondParserToken_LParen, "'('")) {
+            return;
+        }
+
+        uint64_t mask = 0;
+        for (;;) {
+            if (ctx->curToken.type != CondParserToken_ID) {
+                condParserExpect(ctx, CondParserToken_ID, "enumerator");
+                return;
+            }
+
+            int value = ctx->symbols->getEnumerator ? ctx->symbols->getEnumerator(id, ctx->curToken.id) : -1;
+            if (value < 0 || value > 63) {
+                condParserPrintError(ctx, "Error: unknown enumerator: ");
+                condParserPrintError(ctx, ctx->curToken.id);
+                condParserPrintError(ctx, "\n");
+                ctx->error = true;
+            }
+            else {
+                mask |= 1ull << value;
+            }
+            condParserNextToken(ctx);
+
+            if (ctx->curToken.type != CondParserToken_Comma) {
+                break;
+            }
+            condParserNextToken(ctx); // consume ','
+        }
+
+        if (!condParserExpect(ctx, CondParserToken_RParen, "')'")) {
+            return;
+        }
+
+        condParserEmit(ctx, CondParserOp_In);
+        condParserEmitU16(ctx, (unsigned)field);
+        condParserEmitU64(ctx, mask);
+        condParserAdjustDepth(ctx, 1);
+
+        if (ctx->stats) {
+            condParserEstimate(ctx, 0.5f, 1 + ctx->stats->instructionCost);
+        }
+    }
+
+    static void condParserCompileCompare(CondParserContext* ctx, const char* id)
+    {
+        int field = condParserResolveField(ctx, id);
+
+        int32_t lo, hi;
+        if (!condParserParseComparison(ctx, &lo, &hi)) {
+            return;
+        }
+
+        condParserEmit(ctx, CondParserOp_Range);
+        condParserEmitU16(ctx, (unsigned)field);
+        condParserEmitU32(ctx, (uint32_t)lo);
+        condParserEmitU32(ctx, (uint32_t)hi);
+        condParserAdjustDepth(ctx, 1);
+
+        if (ctx->stats) {
+            condParserEstimate(ctx, 0.5f, 1 + ctx->stats->instructionCost);
+        }
+    }
+
+    static CondParserFold condParserCompilePrimary(CondParserContext* ctx)
+    {
+        int constant = condParserConstant(&ctx->curToken);
+
+        if (ctx->curToken.type == CondParserToken_ID) {
+            const CondParserToken id = ctx->curToken;
+            condParserNextToken(ctx);
+
+            if (ctx->curToken.type == CondParserToken_In) {
+                condParserCompileMembership(ctx, id.id);
+            }
+            else if (condParserIsCompare(ctx)) {
+                condParserCompileCompare(ctx, id.id);
+            }
+            else {
+                int slot = condParserResolveSlot(ctx, id.id);
+                condParserEmitSlot(ctx, slot);
+                condParserEstimateSlot(ctx, slot);
+            }
+            return CondParserFold_None;
+        }
+        else if (constant >= 0) {
+            condParserNextToken(ctx);
+            condParserEstimate(ctx, (float)constant, 0);
+            return constant ? CondParserFold_True : CondParserFold_False;
+        }
+        else if (ctx->curToken.type == CondParserToken_LParen) {
+            condParserNextToken(ctx); // consume '('
+            CondParserFold value = condParserCompileExpr(ctx);
+            condParserExpect(ctx, CondParserToken_RParen, "')'");
+            return value;
+        }
+        else if (ctx->curToken.type == CondParserToken_AtLeast || ctx->curToken.type == CondParserToken_AtMost || ctx->curToken.type == CondParserToken_Exactly) {
+            return condParserCompileThreshold(ctx);
+        }
+        else {
+            condParserPrintError(ctx, "Error: expected identifier or '('\n");
+            ctx->error = true;
+            return CondParserFold_None;
+        }
+    }
+
+    static CondParserFold condParserCompileNot(CondParserContext* ctx)
+    {
+        int notCount = 0;
+
+        // count nots
+        while (ctx->curToken.type == CondParserToken_Not)
+        {
+            notCount++;
+            condParserNextToken(ctx);
+        }
+
+        CondParserFold value = condParserCompilePrimary(ctx);
+
+        // negate if odd
+        if (notCount % 2 != 0)
+        {
+            if (value == CondParserFold_None) {
+                condParserEmit(ctx, CondParserOp_Not);
+                if (ctx->stats) {
+                    ctx->cost += ctx->stats->instructionCost;
+                }
+            }
+            else {
+                value = value == CondParserFold_True ? CondParserFold_False : CondParserFold_True;
+            }
+            if (ctx->stats) {
+                ctx->probability = 1 - ctx->probability;
+            }
+        }
+
+        return value;
+    }
+
+    // probability that a binary op given as a truth table (bit a * 2 + b) is true for independent operands
+    static float condParserTableProbability(unsigned table, float a, float b)
+    {
+        float probability = 0;
+        for (int i = 0; i < 4; i++) {
+            if ((table >> i) & 1) {
+                probability += ((i & 2) ? a : 1 - a) * ((i & 1) ? b : 1 - b);
+            }
+        }
+        return probability;
+    }
+
+    // combines two compiled operands with a binary op given as a truth table (bit a * 2 + b), the estimates of a being
+    // passed in and those of b in the context: a constant operand leaves a constant, the other operand or its negation
+    static CondParserFold condParserCompileBinary(CondParserContext* ctx, CondParserOp op, unsigned table, const CondParserMark* start,
+        CondParserFold a, CondParserFold b, float probability, float cost)
+    {
+        float instructionCost = ctx->stats ? ctx->stats->instructionCost : 0;
+        probability = condParserTableProbability(table, probability, ctx->probability);
+        cost += ctx->cost;
+
+        // truth table of the result over the operand that isn't constant
+        unsigned rest;
+        if (a != CondParserFold_None && b != CondParserFold_None) {
+            rest = ((table >> (2 * (a == CondParserFold_True) + (b == CondParserFold_True))) & 1) ? 3 : 0;
+        }
+        else if (a != CondParserFold_None) {
+            rest = (table >> (2 * (a == CondParserFold_True))) & 3;
+        }
+        else if (b != CondParserFold_None) {
+            unsigned k = b == CondParserFold_True;
+            rest = ((table >> k) & 1) | (((table >> (2 + k)) & 1) << 1);
+        }
+        else {
+            condParserEmit(ctx, op);
+            condParserAdjustDepth(ctx, -1);
+            condParserEstimate(ctx, probability, cost + instructionCost);
+            return CondParserFold_None;
+        }
+
+        if (rest == 0 || rest == 3) {
+            condParserTruncate(ctx, start);
+            condParserEstimate(ctx, rest == 3 ? 1.0f : 0.0f, 0);
+            return rest == 3 ? CondParserFold_True : CondParserFold_False;
+        }
+        if (rest == 1) {
+            condParserEmit(ctx, CondParserOp_Not);
+            cost += instructionCost;
+        }
+        condParserEstimate(ctx, probability, cost);
+        return CondParserFold_None;
+    }
+
+    static CondParserFold condParserCompileEquality(CondParserContext* ctx)
+    {
+        CondParserMark start = condParserMark(ctx);
+        CondParserFold value = condParserCompileNot(ctx);
+        while (ctx->curToken.type == CondParserToken_Equal || ctx->curToken.type == CondParserToken_NotEqual) {
+            bool equal = ctx->curToken.type == CondParserToken_Equal;
+            condParserNextToken(ctx);
+
+            float probability = ctx->probability;
+            float cost = ctx->cost;
+            CondParserFold operand = condParserCompileNot(ctx);
+            value = condParserCompileBinary(ctx, equal ? CondParserOp_Equal : CondParserOp_Xor, equal ? 0x9 : 0x6, &start, value, operand, probability, cost);
+        }
+        return value;
+    }
+
+    static CondParserFold condParserCompileXor(CondParserContext* ctx)
+    {
+        CondParserMark start = condParserMark(ctx);
+        CondParserFold value = condParserCompileEquality(ctx);
+        while (ctx->curToken.type == CondParserToken_Xor) {
+            condParserNextToken(ctx);
+
+            float probability = ctx->probability;
+            float cost = ctx->cost;
+            CondParserFold operand = condParserCompileEquality(ctx);
+            value = condParserCompileBinary(ctx, CondParserOp_Xor, 0x6, &start, value, operand, probability, cost);
+        }
+        return value;
+    }
+
+    static void condParserReverseCode(unsigned char* code, int begin, int end)
+    {
+        for (end--; begin < end; begin++, end--) {
+            unsigned char c = code[begin];
+            code[begin] = code[end];
+            code[end] = c;
+        }
+    }
+
+    static void condParserRemoveCode(CondParserProgram* program, int pos, int count)
+    {
+        for (int i = pos; i + count < program->size; i++) {
+            program->code[i] = program->code[i + count];
+        }
+        program->size -= count;
+    }
+
+    // compiles a chain like condParserCompileChain, but orders the operands for the lowest expected cost: each operand
+    // is compiled as a self-contained unit (jump, operand, and/or) that can be moved, the first unit then loses its
+    // jump and and/or
+    static CondParserFold condParserCompilePlannedChain(CondParserContext* ctx, CondParserTokenType type, CondParserFold (*compileOperand)(CondParserContext*))
+    {
+        bool isAnd = type == CondParserToken_And;
+        CondParserFold absorbing = isAnd ? CondParserFold_False : CondParserFold_True;
+        CondParserMark start = condParserMark(ctx);
+        float instructionCost = ctx->stats->instructionCost;
+
+        struct
+        {
+            int size;
+            float probability;
+            float cost;
+        } units[CONDPARSER_STACK_SIZE];
+        int numUnits = 0;
+        bool absorbed = false;
+
+        for (;;) {
+            // depths are those of the source order, condParserCompilePlanned recomputes maxStack for the final one
+            ctx->depth = start.depth + (numUnits > 0 ? 1 : 0);
+            CondParserMark unitStart = condParserMark(ctx);
+            int jump = condParserEmitJump(ctx, isAnd ? CondParserOp_JumpIfFalse : CondParserOp_JumpIfTrue);
+
+            CondParserFold operand = compileOperand(ctx);
+            condParserEmit(ctx, isAnd ? CondParserOp_And : CondParserOp_Or);
+            condParserPatchJump(ctx, jump);
+            ctx->depth = start.depth + 1;
+
+            if (operand != CondParserFold_None || absorbed) {
+                // constants and dead operands leave no code, the absorbing constant decides the chain
+                condParserTruncate(ctx, &unitStart);
+                absorbed = absorbed || operand == absorbing;
+            }
+            else if (numUnits < CONDPARSER_STACK_SIZE) {
+                units[numUnits].size = ctx->program->size - unitStart.size;
+                units[numUnits].probability = isAnd ? ctx->probability : 1 - ctx->probability;
+                units[numUnits].cost = ctx->cost;
+                numUnits++;
+            }
+            // operands past that many stay in source order after the planned ones
+
+            if (ctx->curToken.type != type) {
+                break;
+            }
+            condParserNextToken(ctx);
+        }
+
+        if (absorbed || numUnits == 0) {
+            condParserTruncate(ctx, &start);
+            CondParserFold value = absorbed ? absorbing : (absorbing == CondParserFold_True ? CondParserFold_False : CondParserFold_True);
+            condParserEstimate(ctx, value == CondParserFold_True ? 1.0f : 0.0f, 0);
+            return value;
+        }
+
+        if (ctx->error) {
+            return CondParserFold_None;
+        }
+
+        // an operand that continues the chain with probability p is best placed by cost / (1 - p)
+        // probabilities are kept as the chance of continuing, p for && and 1 - p for ||
+        int pos = start.size;
+        float reach = 1;
+        float cost = 0;
+        for (int i = 0; i < numUnits; i++) {
+            int best = i;
+            for (int k = i + 1; k < numUnits; k++) {
+                float bestStop = 1 - units[best].probability > 1e-6f ? 1 - units[best].probability : 1e-6f;
+                float stop = 1 - units[k].probability > 1e-6f ? 1 - units[k].probability : 1e-6f;
+                if (units[k].cost * bestStop < units[best].cost * stop) {
+                    best = k;
+                }
+            }
+
+            // rotate the best unit in front of the units still to be placed
+            int bestPos = pos;
+            for (int k = i; k < best; k++) {
+                bestPos += units[k].size;
+            }
+            int bestEnd = bestPos + units[best].size;
+            condParserReverseCode(ctx->program->code, pos, bestPos);
+            condParserReverseCode(ctx->program->code, bestPos, bestEnd);
+            condParserReverseCode(ctx->program->code, pos, bestEnd);
+
+            float probability = units[best].probability;
+            float unitCost = units[best].cost;
+            int size = units[best].size;
+            for (int k = best; k > i; k--) {
+                units[k] = units[k - 1];
+            }
+            units[i].size = size;
+            units[i].probability = probability;
+            units[i].cost = unitCost;
+
+            // every jump runs, the operand and the and/or only while the chain continues
+            cost += i == 0 ? unitCost : instructionCost + reach * (unitCost + instructionCost);
+            reach *= probability;
+            pos += size;
+        }
+
+        condParserRemoveCode(ctx->program, start.size + units[0].size - 1, 1);
+        condParserRemoveCode(ctx->program, start.size, 3);
+        ctx->depth = start.depth + 1;
+
+        condParserEstimate(ctx, isAnd ? reach : 1 - reach, cost);
+        return CondParserFold_None;
+    }
+
+    // compiles a chain of && (or ||), folding constant operands: the absorbing constant (false for &&, true for ||)
+    // discards the whole chain, the neutral one is dropped
+    static CondParserFold condParserCompileChain(CondParserContext* ctx, CondParserTokenType type, CondParserFold (*compileOperand)(CondParserContext*))
+    {
+        if (ctx->stats) {
+            return condParserCompilePlannedChain(ctx, type, compileOperand);
+        }
+
+        bool isAnd = type == CondParserToken_And;
+        CondParserFold absorbing = isAnd ? CondParserFold_False : CondParserFold_True;
+        CondParserMark start = condParserMark(ctx);
+
+        CondParserFold value = compileOperand(ctx);
+        while (ctx->curToken.type == type) {
+            condParserNextToken(ctx);
+
+            CondParserMark operandStart = condParserMark(ctx);
+            if (value == absorbing) {
+                // still compiled for its errors
+                compileOperand(ctx);
+                condParserTruncate(ctx, &operandStart);
+                continue;
+            }
+
+            int jump = -1;
+            if (value == CondParserFold_None) {
+                jump = condParserEmitJump(ctx, isAnd ? CondParserOp_JumpIfFalse : CondParserOp_JumpIfTrue);
+            }
+
+            CondParserFold operand = compileOperand(ctx);
+            if (value != CondParserFold_None) {
+                value = operand;
+            }
+            else if (operand == absorbing) {
+                condParserTruncate(ctx, &start);
+                value = absorbing;
+            }
+            else if (operand != CondParserFold_None) {
+                condParserTruncate(ctx, &operandStart);
+            }
+            else {
+                condParserEmit(ctx, isAnd ? CondParserOp_And : CondParserOp_Or);
+                condParserAdjustDepth(ctx, -1);
+                condParserPatchJump(ctx, jump);
+            }
+        }
+
+        return value;
+    }
+
+    static CondParserFold condParserCompileAnd(CondParserContext* ctx)
+    {
+        return condParserCompileChain(ctx, CondParserToken_And, condParserCompileXor);
+    }
+
+    static CondParserFold condParserCompileOr(CondParserContext* ctx)
+    {
+        return condParserCompileChain(ctx, CondParserToken_Or, condParserCompileAnd);
+    }
+
+    static CondParserFold condParserCompileImplies(CondParserContext* ctx)
+    {
+        CondParserMark start = condParserMark(ctx);
+        CondParserFold value = condParserCompileOr(ctx);
+        if (ctx->curToken.type != CondParserToken_Implies) {
+            return value;
+        }
+        condParserNextToken(ctx);
+
+        float probability = ctx->probability;
+        float cost = ctx->cost;
+        CondParserFold operand = condParserCompileImplies(ctx);
+        return condParserCompileBinary(ctx, CondParserOp_Implies, 0xb, &start, value, operand, probability, cost);
+    }
+
+    // compiles c ? t : e to a select, or to a single and/or/implication when a branch is constant
+    static CondParserFold condParserCompileSelect(CondParserContext* ctx)
+    {
+        CondParserMark start = condParserMark(ctx);
+        CondParserFold condition = condParserCompileImplies(ctx);
+        if (ctx->curToken.type != CondParserToken_Question) {
+            return condition;
+        }
+        condParserNextToken(ctx); // consume '?'
+
+        float instructionCost = ctx->stats ? ctx->stats->instructionCost : 0;
+        float probability = ctx->probability;
+        float cost = ctx->cost;
+
+        // a constant condition keeps one branch, the other is still compiled for its errors
+        CondParserMark branch = condParserMark(ctx);
+        CondParserFold then = condParserCompileSelect(ctx);
+        if (condition == CondParserFold_False) {
+            condParserTruncate(ctx, &branch);
+        }
+        float thenProbability = ctx->probability;
+        float thenCost = ctx->cost;
+
+        bool negated = false;
+        if (condition == CondParserFold_None && then == CondParserFold_False) {
+            // c ? false : e is !c && e
+            condParserEmit(ctx, CondParserOp_Not);
+            negated = true;
+        }
+
+        if (!condParserExpect(ctx, CondParserToken_Colon, "':'")) {
+            return CondParserFold_None;
+        }
+
+        branch = condParserMark(ctx);
+        CondParserFold otherwise = condParserCompileSelect(ctx);
+        if (condition == CondParserFold_True) {
+            condParserTruncate(ctx, &branch);
+            condParserEstimate(ctx, thenProbability, thenCost);
+            return then;
+        }
+        if (condition == CondParserFold_False) {
+            return otherwise;
+        }
+
+        probability = probability * thenProbability + (1 - probability) * ctx->probability;
+        cost += thenCost + ctx->cost + instructionCost * (negated ? 2 : 1);
+
+        if (then != CondParserFold_None && otherwise != CondParserFold_None) {
+            if (then == otherwise) {
+                condParserTruncate(ctx, &start);
+                condParserEstimate(ctx, then == CondParserFold_True ? 1.0f : 0.0f, 0);
+                return then;
+            }
+            // c or !c is already on the stack
+            condParserEstimate(ctx, probability, cost - instructionCost);
+            return CondParserFold_None;
+        }
+
+        if (then != CondParserFold_None) {
+            condParserEmit(ctx, negated ? CondParserOp_And : CondParserOp_Or);
+            condParserAdjustDepth(ctx, -1);
+        }
+        else if (otherwise != CondParserFold_None) {
+            // c ? t : true is c -> t, c ? t : false is c && t
+            condParserEmit(ctx, otherwise == CondParserFold_True ? CondParserOp_Implies : CondParserOp_And);
+            condParserAdjustDepth(ctx, -1);
+        }
+        else {
+            condParserEmit(ctx, CondParserOp_Select);
+            condParserAdjustDepth(ctx, -2);
+        }
+        condParserEstimate(ctx, probability, cost);
+        return CondParserFold_None;
+    }
+
+    static CondParserFold condParserCompileExpr(CondParserContext* ctx)
+    {
+        return condParserCompileSelect(ctx);
+    }
+
+    static bool condParserCompileContext(CondParserContext* ctx)
+    {
+        CondParserProgram* program = ctx->program;
+        program->size = 0;
+        program->numSlots = 0;
+        program->numFields = 0;
+        program->maxStack = 0;
+        program->verified = false;
+
+        condParserNextToken(ctx);
+        CondParserFold value = condParserCompileExpr(ctx);
+
+        // constants only materialise when the whole expression folds
+        if (value != CondParserFold_None) {
+            condParserEmit(ctx, value == CondParserFold_True ? CondParserOp_True : CondParserOp_False);
+            condParserAdjustDepth(ctx, 1);
+        }
+
+        if (ctx->curToken.type != CondParserToken_End) {
+            condParserPrintError(ctx, "Error: unexpected token: ");
+            condParserPrintToken(ctx);
+            condParserPrintError(ctx, "\n");
+            ctx->error = true;
+        }
+
+        if (program->maxStack > CONDPARSER_STACK_SIZE) {
+            condParserPrintError(ctx, "Error: expression too deeply nested\n");
+            ctx->error = true;
+        }
+
+        // folding may have truncated the program after it overflowed
+        if (ctx->overflow) {
+            program->size = program->capacity;
+        }
+
+        program->verified = !ctx->error;
+        return !ctx->error;
+    }
+
+    static void condParserInitCompile(CondParserContext* ctx, const char* expr, const CondParserSymbols* symbols, PFN_condParserError errorFn, CondParserProgram* program)
+    {
+        ctx->cur = expr;
+        ctx->error = false;
+        ctx->overflow = false;
+        ctx->getValue = NULL;
+        ctx->getEnum = NULL;
+        ctx->getNumber = NULL;
+        ctx->errorFn = errorFn;
+        ctx->symbols = symbols;
+        ctx->program = program;
+        ctx->depth = 0;
+        ctx->tokens = NULL;
+        ctx->stats = NULL;
+        ctx->probability = 0;
+        ctx->cost = 0;
+    }
+
+    bool condParserCompile(const char* expr, const CondParserSymbols* symbols, PFN_condParserError errorFn, CondParserProgram* program)
+    {
+        CondParserContext ctx;
+        condParserInitCompile(&ctx, expr, symbols, errorFn, program);
+        return condParserCompileContext(&ctx);
+    }
+
+    bool condParserCompileTokens(const char* expr, const CondParserTokenSpan* tokens, const CondParserSymbols* symbols, PFN_condParserError errorFn, CondParserProgram* program)
+    {
+        CondParserContext ctx;
+        condParserInitCompile(&ctx, expr, symbols, errorFn, program);
+        ctx.tokens = tokens;
+        return condParserCompileContext(&ctx);
+    }
+
+    // returns the size of the instruction at pc, or 0 if it is invalid or runs past the end
+    static int condParserInstructionSize(const unsigned char* pc, const unsigned char* end)
+    {
+        int size;
+        switch (*pc)
+        {
+        case CondParserOp_Not:
+        case CondParserOp_And:
+        case CondParserOp_Or:
+        case CondParserOp_False:
+        case CondParserOp_True:
+        case CondParserOp_Xor:
+        case CondParserOp_Equal:
+        case CondParserOp_Implies:
+        case CondParserOp_Select:
+            size = 1;
+            break;
+        case CondParserOp_Slot:
+        case CondParserOp_JumpIfFalse:
+        case CondParserOp_JumpIfTrue:
+            size = 3;
+            break;
+        case CondParserOp_AtLeast:
+        case CondParserOp_AtMost:
+        case CondParserOp_Exactly:
+            if (end - pc < 7) {
+                return 0;
+            }
+            size = 7 + 10 * (int)condParserReadU16(pc + 5);
+            break;
+        case CondParserOp_In:
+        case CondParserOp_Range:
+            size = 11;
+            break;
+        case CondParserOp_Table:
+            if (end - pc < 3 || condParserReadU16(pc + 1) > CONDPARSER_TABLE_SLOTS) {
+                return 0;
+            }
+            size = 11 + 2 * (int)condParserReadU16(pc + 1);
+            break;
+        default:
+            return 0;
+        }
+        return end - pc >= size ? size : 0;
+    }
+
+    static bool condParserVerifyError(PFN_condParserError errorFn, const char* msg)
+    {
+        if (errorFn) {
+            errorFn(msg);
+        }
+        return false;
+    }
+
+    bool condParserVerify(CondParserProgram* program, int numSlots, int numFields, PFN_condParserError errorFn)
+    {
+        // jumps only go forward, so each one is settled once the walk reaches its target
+        struct
+        {
+            int target;
+            int depth;
+        } pending[CONDPARSER_STACK_SIZE];
+        int numPending = 0;
+
+        int depth = 0;
+        int maxStack = 0;
+        int usedSlots = 0;
+        int usedFields = 0;
+
+        program->verified = false;
+
+        const unsigned char* code = program->code;
+        const unsigned char* end = code + program->size;
+        int pos = 0;
+
+        for (;;) {
+            for (int i = 0; i < numPending;) {
+                if (pending[i].target < pos) {
+                    return condParserVerifyError(errorFn, "Error: jump into the middle of an instruction\n");
+                }
+                if (pending[i].target == pos) {
+                    if (pending[i].depth != depth) {
+                        return condParserVerifyError(errorFn, "Error: stack depth differs at jump target\n");
+                    }
+                    pending[i] = pending[--numPending];
+                }
+                else {
+                    i++;
+                }
+            }
+
+            if (pos == program->size) {
+                break;
+            }
+
+            const unsigned char* pc = code + pos;
+            int size = condParserInstructionSize(pc, end);
+            if (size == 0) {
+                return condParserVerifyError(errorFn, "Error: invalid or truncated instruction\n");
+            }
+
+            int pops = 0;
+            int target = -1;
+            switch (*pc)
+            {
+            case CondParserOp_Slot: {
+                int slot = (int)condParserReadU16(pc + 1);
+                if (slot >= numSlots) {
+                    return condParserVerifyError(errorFn, "Error: slot out of range\n");
+                }
+                if (slot >= usedSlots) {
+                    usedSlots = slot + 1;
+                }
+                break;
+            }
+            case CondParserOp_Not:
+                pops = 1;
+                break;
+            case CondParserOp_And:
+            case CondParserOp_Or:
+            case CondParserOp_Xor:
+            case CondParserOp_Equal:
+            case CondParserOp_Implies:
+                pops = 2;
+                break;
+            case CondParserOp_Select:
+                pops = 3;
+                break;
+            case CondParserOp_JumpIfFalse:
+            case CondParserOp_JumpIfTrue:
+                pops = 1;
+                target = pos + size + (int)condParserReadU16(pc + 1);
+                if (target > program->size) {
+                    return condParserVerifyError(errorFn, "Error: jump out of range\n");
+                }
+                break;
+            case CondParserOp_AtLeast:
+            case CondParserOp_AtMost:
+            case CondParserOp_Exactly: {
+                pops = (int)condParserReadU16(pc + 3);
+                int numMasks = (int)condParserReadU16(pc + 5);
+                for (int i = 0; i < numMasks; i++) {
+                    int word = (int)condParserReadU16(pc + 7 + i * 10);
+                    uint64_t mask = condParserReadU64(pc + 9 + i * 10);
+                    if (mask == 0) {
+                        return condParserVerifyError(errorFn, "Error: empty threshold mask\n");
+                    }
+
+                    int slot = word * 64 + 63;
+                    while (!((mask >> (slot & 63)) & 1)) slot--;
+                    if (slot >= numSlots) {
+                        return condParserVerifyError(errorFn, "Error: slot out of range\n");
+                    }
+                    if (slot >= usedSlots) {
+                        usedSlots = slot + 1;
+                    }
+                }
+                break;
+            }
+            case CondParserOp_In:
+            case CondParserOp_Range: {
+                int field = (int)condParserReadU16(pc + 1);
+                if (field >= numFields) {
+                    return condParserVerifyError(errorFn, "Error: field out of range\n");
+                }
+                if (field >= usedFields) {
+                    usedFields = field + 1;
+                }
+                break;
+            }
+            case CondParserOp_Table:
+                for (int j = 0; j < (int)condParserReadU16(pc + 1); j++) {
+                    int slot = (int)condParserReadU16(pc + 3 + j * 2);
+                    if (slot >= numSlots) {
+                        return condParserVerifyError(errorFn, "Error: slot out of range\n");
+                    }
+                    if (slot >= usedSlots) {
+                        usedSlots = slot + 1;
+                    }
+                }
+                break;
+            }
+
+            if (depth < pops) {
+                return condParserVerifyError(errorFn, "Error: stack underflow\n");
+            }
+
+            // a jump keeps the top of the stack, so its target sees the current depth
+            if (target >= 0) {
+                if (numPending == CONDPARSER_STACK_SIZE) {
+                    return condParserVerifyError(errorFn, "Error: too many pending jumps\n");
+                }
+                pending[numPending].target = target;
+                pending[numPending].depth = depth;
+                numPending++;
+            }
+
+            depth += 1 - pops;
+            if (depth > maxStack) {
+                maxStack = depth;
+            }
+            if (maxStack > CONDPARSER_STACK_SIZE) {
+                return condParserVerifyError(errorFn, "Error: stack overflow\n");
+            }
+
+            pos += size;
+        }
+
+        if (depth != 1) {
+            return condParserVerifyError(errorFn, "Error: program must leave exactly one value\n");
+        }
+
+        program->numSlots = usedSlots;
+        program->numFields = usedFields;
+        program->maxStack = maxStack;
+        program->verified = true;
+        return true;
+    }
+
+    // bails out of an unverified program that turns out to be malformed
+#define CONDPARSER_CHECK(cond, fail) if (checked && !(cond)) { return fail; }
+
+    // word w of the slots, read through the chunk table of version if it's not NULL, words past it read as zero
+    static uint64_t condParserEnvWord(const CondParserEnv* env, const CondParserVersion* version, unsigned w)
+    {
+        if (version == NULL) {
+            return env->bits[w];
+        }
+        unsigned c = w / CONDPARSER_VERSION_CHUNK_WORDS;
+        return (int)w * 64 < version->numSlots ? version->chunks[c][w % CONDPARSER_VERSION_CHUNK_WORDS] : 0;
+    }
+
+    // readSlots and readFields, if not NULL, receive the slots and fields the evaluation reads
+    static bool condParserExecuteProgram(const CondParserProgram* program, const CondParserEnv* env, const CondParserVersion* version, bool checked, uint64_t* readSlots, uint64_t* readFields)
+    {
+        bool stack[CONDPARSER_STACK_SIZE];
+        int top = -1;
+
+        const unsigned char* pc = program->code;
+        const unsigned char* end = pc + program->size;
+
+        while (pc < end) {
+            CONDPARSER_CHECK(condParserInstructionSize(pc, end) != 0, false);
+
+            unsigned op = *pc++;
+            switch (op)
+            {
+            case CondParserOp_Slot: {
+                unsigned slot = condParserReadU16(pc);
+                pc += 2;
+                CONDPARSER_CHECK(slot < (unsigned)program->numSlots && top + 1 < CONDPARSER_STACK_SIZE, false);
+                stack[++top] = (condParserEnvWord(env, version, slot >> 6) >> (slot & 63)) & 1;
+                if (readSlots) {
+                    readSlots[slot >> 6] |= 1ull << (slot & 63);
+                }
+                break;
+            }
+            case CondParserOp_Not:
+                CONDPARSER_CHECK(top >= 0, false);
+                stack[top] = !stack[top];
+                break;
+            case CondParserOp_And:
+                CONDPARSER_CHECK(top >= 1, false);
+                top--;
+                stack[top] = stack[top] && stack[top + 1];
+                break;
+            case CondParserOp_Or:
+                CONDPARSER_CHECK(top >= 1, false);
+                top--;
+                stack[top] = stack[top] || stack[top + 1];
+                break;
+            case CondParserOp_Xor:
+                CONDPARSER_CHECK(top >= 1, false);
+                top--;
+                stack[top] = stack[top] != stack[top + 1];
+                break;
+            case CondParserOp_Equal:
+                CONDPARSER_CHECK(top >= 1, false);
+                top--;
+                stack[top] = stack[top] == stack[top + 1];
+                break;
+            case CondParserOp_Implies:
+                CONDPARSER_CHECK(top >= 1, false);
+                top--;
+                stack[top] = !stack[top] || stack[top + 1];
+                break;
+            case CondParserOp_Select:
+                CONDPARSER_CHECK(top >= 2, false);
+                top -= 2;
+                stack[top] = stack[top] ? stack[top + 1] : stack[top + 2];
+                break;
+            case CondParserOp_JumpIfFalse: {
+                unsigned offset = condParserReadU16(pc);
+                pc += 2;
+                CONDPARSER_CHECK(top >= 0 && offset <= (unsigned)(end - pc), false);
+                if (!stack[top]) {
+                    pc += offset;
+                }
+                break;
+            }
+            case CondParserOp_JumpIfTrue: {
+                unsigned offset = condParserReadU16(pc);
+                pc += 2;
+                CONDPARSER_CHECK(top >= 0 && offset <= (unsigned)(end - pc), false);
+                if (stack[top]) {
+                    pc += offset;
+                }
+                break;
+            }
+            case CondParserOp_AtLeast:
+            case CondParserOp_AtMost:
+            case CondParserOp_Exactly: {
+                unsigned count = condParserReadU16(pc);
+                unsigned numStack = condParserReadU16(pc + 2);
+                unsigned numMasks = condParserReadU16(pc + 4);
+                pc += 6;
+                CONDPARSER_CHECK((int)numStack <= top + 1 && top + 1 - (int)numStack < CONDPARSER_STACK_SIZE, false);
+
+                unsigned numTrue = 0;
+                for (unsigned i = 0; i < numStack; i++) {
+                    numTrue += stack[top--];
+                }
+                for (unsigned i = 0; i < numMasks; i++, pc += 10) {
+                    unsigned word = condParserReadU16(pc);
+                    CONDPARSER_CHECK(word * 64 < (unsigned)program->numSlots, false);
+                    numTrue += (unsigned)condParserPopcount64(condParserEnvWord(env, version, word) & condParserReadU64(pc + 2));
+                    if (readSlots) {
+                        readSlots[word] |= condParserReadU64(pc + 2);
+                    }
+                }
+
+                stack[++top] = condParserThresholdHolds(op, numTrue, count);
+                break;
+            }
+            case CondParserOp_In: {
+                unsigned field = condParserReadU16(pc);
+                uint64_t mask = condParserReadU64(pc + 2);
+                pc += 10;
+                CONDPARSER_CHECK(field < (unsigned)program->numFields && top + 1 < CONDPARSER_STACK_SIZE, false);
+
+                uint32_t value = (uint32_t)env->fields[field];
+                stack[++top] = value < 64 && ((mask >> value) & 1);
+                if (readFields) {
+                    readFields[field >> 6] |= 1ull << (field & 63);
+                }
+                break;
+            }
+            case CondParserOp_Range: {
+                unsigned field = condParserReadU16(pc);
+                uint32_t lo = condParserReadU32(pc + 2);
+                uint32_t hi = condParserReadU32(pc + 6);
+                pc += 10;
+                CONDPARSER_CHECK(field < (unsigned)program->numFields && top + 1 < CONDPARSER_STACK_SIZE, false);
+
+                stack[++top] = condParserRangeHolds(env->fields[field], lo, hi);
+                if (readFields) {
+                    readFields[field >> 6] |= 1ull << (field & 63);
+                }
+                break;
+            }
+            case CondParserOp_False:
+                CONDPARSER_CHECK(top + 1 < CONDPARSER_STACK_SIZE, false);
+                stack[++top] = false;
+                break;
+            case CondParserOp_True:
+                CONDPARSER_CHECK(top + 1 < CONDPARSER_STACK_SIZE, false);
+                stack[++top] = true;
+                break;
+            case CondParserOp_Table: {
+                unsigned numSlots = condParserReadU16(pc);
+                CONDPARSER_CHECK(top + 1 < CONDPARSER_STACK_SIZE, false);
+
+                unsigned index = 0;
+                for (unsigned j = 0; j < numSlots; j++) {
+                    unsigned slot = condParserReadU16(pc + 2 + j * 2);
+                    CONDPARSER_CHECK(slot < (unsigned)program->numSlots, false);
+                    index |= (unsigned)((condParserEnvWord(env, version, slot >> 6) >> (slot & 63)) & 1) << j;
+                    if (readSlots) {
+                        readSlots[slot >> 6] |= 1ull << (slot & 63);
+                    }
+                }
+                stack[++top] = (condParserReadU64(pc + 2 + numSlots * 2) >> index) & 1;
+                pc += 10 + numSlots * 2;
+                break;
+            }
+            }
+        }
+
+        CONDPARSER_CHECK(top == 0, false);
+        return top >= 0 && stack[top];
+    }
+
+    bool condParserExecute(const CondParserProgram* program, const CondParserEnv* env)
+    {
+        if (program->verified) {
+            return condParserExecuteProgram(program, env, NULL, false, NULL, NULL);
+        }
+        return condParserExecuteProgram(program, env, NULL, true, NULL, NULL);
+    }
+
+    static void condParserClearSpeculation(const CondParserProgram* program, CondParserSpeculation* speculation)
+    {
+        for (int w = 0; w < (program->numSlots + 63) >> 6; w++) {
+            speculation->slots[w] = 0;
+        }
+        for (int w = 0; speculation->fields && w < (program->numFields + 63) >> 6; w++) {
+            speculation->fields[w] = 0;
+        }
+    }
+
+    bool condParserSpeculate(const CondParserProgram* program, const CondParserEnv* env, const uint64_t* pendingSlots, const uint64_t* pendingFields, CondParserSpeculation* speculation)
+    {
+        condParserClearSpeculation(program, speculation);
+
+        // the result only depends on what the evaluation reads, short-circuited operands aside
+        speculation->result = condParserExecuteProgram(program, env, NULL, !program->verified, speculation->slots, speculation->fields);
+
+        for (int w = 0; w < (program->numSlots + 63) >> 6; w++) {
+            speculation->slots[w] &= pendingSlots ? pendingSlots[w] : 0;
+        }
+        for (int w = 0; speculation->fields && w < (program->numFields + 63) >> 6; w++) {
+            speculation->fields[w] &= pendingFields ? pendingFields[w] : 0;
+        }
+        return speculation->result;
+    }
+
+    bool condParserConfirm(const CondParserProgram* program, const CondParserEnv* env, const uint64_t* changedSlots, const uint64_t* changedFields, CondParserSpeculation* speculation)
+    {
+        bool changed = false;
+        for (int w = 0; changedSlots && w < (program->numSlots + 63) >> 6; w++) {
+            changed = changed || (speculation->slots[w] & changedSlots[w]) != 0;
+        }
+        for (int w = 0; changedFields && speculation->fields && w < (program->numFields + 63) >> 6; w++) {
+            changed = changed || (speculation->fields[w] & changedFields[w]) != 0;
+        }
+
+        // if nothing the result read changed, evaluating again would take the same path
+        if (!changed) {
+            condParserClearSpeculation(program, speculation);
+            return false;
+        }
+
+        bool result = speculation->result;
+        condParserSpeculate(program, env, NULL, NULL, speculation);
+        return speculation->result != result;
+    }
+
+#define CONDPARSER_VERSION_CHUNK_SLOTS (CONDPARSER_VERSION_CHUNK_WORDS * 64)
+
+    void condParserVersionArenaInit(CondParserVersionArena* arena, uint64_t* words, int capacity, const uint64_t** pointers, int pointerCapacity)
+    {
+        arena->words = words;
+        arena->capacity = capacity;
+        arena->numWords = 0;
+        arena->pointers = pointers;
+        arena->pointerCapacity = pointerCapacity;
+        arena->numPointers = 0;
+    }
+
+    static uint64_t* condParserVersionChunk(CondParserVersionArena* arena)
+    {
+        if (arena->capacity - arena->numWords < CONDPARSER_VERSION_CHUNK_WORDS) {
+            return NULL;
+        }
+        uint64_t* chunk = arena->words + arena->numWords;
+        arena->numWords += CONDPARSER_VERSION_CHUNK_WORDS;
+        return chunk;
+    }
+
+    static const uint64_t** condParserVersionTable(CondParserVersionArena* arena, int numChunks)
+    {
+        if (arena->pointerCapacity - arena->numPointers < numChunks) {
+            return NULL;
+        }
+        const uint64_t** table = arena->pointers + arena->numPointers;
+        arena->numPointers += numChunks;
+        return table;
+    }
+
+    bool condParserVersionInit(CondParserVersion* version, CondParserVersionArena* arena, const uint64_t* bits, int numSlots)
+    {
+        int numChunks = (numSlots + CONDPARSER_VERSION_CHUNK_SLOTS - 1) / CONDPARSER_VERSION_CHUNK_SLOTS;
+        int numWords = (numSlots + 63) >> 6;
+        int numArenaWords = arena->numWords;
+        int numArenaPointers = arena->numPointers;
+
+        const uint64_t** table = condParserVersionTable(arena, numChunks);
+        const uint64_t* zero = NULL;
+        for (int c = 0; table && c < numChunks; c++) {
+            uint64_t any = 0;
+            for (int i = c * CONDPARSER_VERSION_CHUNK_WORDS; i < numWords && i < (c + 1) * CONDPARSER_VERSION_CHUNK_WORDS; i++) {
+                any |= bits[i];
+            }
+            if (any == 0 && zero) {
+                table[c] = zero;
+                continue;
+            }
+
+            uint64_t* chunk = condParserVersionChunk(arena);
+            if (chunk == NULL) {
+                table = NULL;
+                break;
+            }
+
+            // the bits past numSlots are cleared
+            for (int i = 0; i < CONDPARSER_VERSION_CHUNK_WORDS; i++) {
+                int w = c * CONDPARSER_VERSION_CHUNK_WORDS + i;
+                uint64_t tail = (w + 1) * 64 > numSlots ? ~(~0ull << (numSlots & 63)) : ~0ull;
+                chunk[i] = w < numWords ? bits[w] & tail : 0;
+            }
+            table[c] = chunk;
+            zero = any == 0 ? chunk : zero;
+        }
+
+        if (table == NULL) {
+            arena->numWords = numArenaWords;
+            arena->numPointers = numArenaPointers;
+            return false;
+        }
+
+        version->chunks = table;
+        version->numSlots = numSlots;
+        return true;
+    }
+
+    bool condParserVersionSet(CondParserVersion* version, const CondParserVersion* base, CondParserVersionArena* arena, const int* slots, const bool* values, int numChanges)
+    {
+        int numChunks = (base->numSlots + CONDPARSER_VERSION_CHUNK_SLOTS - 1) / CONDPARSER_VERSION_CHUNK_SLOTS;
+        int numArenaWords = arena->numWords;
+        int numArenaPointers = arena->numPointers;
+
+        const uint64_t** table = condParserVersionTable(arena, numChunks);
+        for (int c = 0; table && c < numChunks; c++) {
+            table[c] = base->chunks[c];
+        }
+
+        for (int i = 0; table && i < numChanges; i++) {
+            int slot = slots[i];
+            if (slot < 0 || slot >= base->numSlots) {
+                continue;
+            }
+
+            // chunks still shared with base are copied on the first change
+            int c = slot / CONDPARSER_VERSION_CHUNK_SLOTS;
+            if (table[c] == base->chunks[c]) {
+                uint64_t* chunk = condParserVersionChunk(arena);
+                if (chunk == NULL) {
+                    table = NULL;
+                    break;
+                }
+                for (int k = 0; k < CONDPARSER_VERSION_CHUNK_WORDS; k++) {
+                    chunk[k] = base->chunks[c][k];
+                }
+                table[c] = chunk;
+            }
+
+            uint64_t* word = (uint64_t*)table[c] + ((slot >> 6) % CONDPARSER_VERSION_CHUNK_WORDS);
+            uint64_t bit = 1ull << (slot & 63);
+            *word = values[i] ? (*word | bit) : (*word & ~bit);
+        }
+
+        if (table == NULL) {
+            arena->numWords = numArenaWords;
+            arena->numPointers = numArenaPointers;
+            return false;
+        }
+
+        version->chunks = table;
+        version->numSlots = base->numSlots;
+        return true;
+    }
+
+    bool condParserVersionGet(const CondParserVersion* version, int slot)
+    {
+        if (slot < 0 || slot >= version->numSlots) {
+            return false;
+        }
+        const uint64_t* chunk = version->chunks[slot / CONDPARSER_VERSION_CHUNK_SLOTS];
+        return (chunk[(slot >> 6) % CONDPARSER_VERSION_CHUNK_WORDS] >> (slot & 63)) & 1;
+    }
+
+    bool condParserExecuteVersion(const CondParserProgram* program, const CondParserVersion* version, const int32_t* fields)
+    {
+        if (program->numSlots <= CONDPARSER_VERSION_CHUNK_SLOTS && version->numSlots > 0) {
+            // the first chunk is a bitset of its own, cleared past numSlots
+            const CondParserEnv env = { version->chunks[0], fields };
+            return condParserExecute(program, &env);
+        }
+
+        // otherwise every word is read through the chunk table
+        const CondParserEnv env = { NULL, fields };
+        if (program->verified) {
+            return condParserExecuteProgram(program, &env, version, false, NULL, NULL);
+        }
+        return condParserExecuteProgram(program, &env, version, true, NULL, NULL);
+    }
+
+#undef CONDPARSER_VERSION_CHUNK_SLOTS
+
+    // adds one bit-sliced value to a bit-sliced counter
+    static void condParserCountAdd(uint64_t* planes, uint64_t value)
+    {
+        for (int i = 0; value != 0 && i < CONDPARSER_COUNT_PLANES; i++) {
+            uint64_t carry = planes[i] & value;
+            planes[i] ^= value;
+            value = carry;
+        }
+    }
+
+    static uint64_t condParserCountCompare(unsigned op, const uint64_t* planes, unsigned count)
+    {
+        uint64_t greater = 0;
+        uint64_t equal = ~0ull;
+
+        // compare from the most significant plane down
+        for (int i = CONDPARSER_COUNT_PLANES - 1; i >= 0; i--) {
+            if ((count >> i) & 1) {
+                equal &= planes[i];
+            }
+            else {
+                greater |= equal & planes[i];
+                equal &= ~planes[i];
+            }
+        }
+
+        switch (op)
+        {
+        case CondParserOp_AtMost:
+            return ~greater;
+        case CondParserOp_Exactly:
+            return equal;
+        default:
+            return greater | equal;
+        }
+    }
+
+    // reads count bits of an LSB-ordered bitmap starting at any bit, the bits past count are zero
+    static uint64_t condParserLoadBits(const unsigned char* bitmap, int64_t bit, int count)
+    {
+        const unsigned char* p = bitmap + (bit >> 3);
+        int shift = (int)(bit & 7);
+
+        if (count == 64) {
+            uint64_t bits = condParserReadU64(p) >> shift;
+            return shift != 0 ? bits | ((uint64_t)p[8] << (64 - shift)) : bits;
+        }
+
+        // only touch the bytes holding the bits, the buffer may end right after them
+        int numBytes = (shift + count + 7) >> 3;
+        uint64_t bits = 0;
+        for (int i = 0; i < numBytes && i < 8; i++) {
+            bits |= (uint64_t)p[i] << (i * 8);
+        }
+        bits >>= shift;
+        if (numBytes > 8) {
+            bits |= (uint64_t)p[8] << (64 - shift);
+        }
+        return bits & ((1ull << count) - 1);
+    }
+
+    static int condParserArrowCount(const CondParserArrowBatch* arrow, int w)
+    {
+        int64_t remaining = arrow->length - (int64_t)w * 64;
+        return remaining < 64 ? (int)remaining : 64;
+    }
+
+    static uint64_t condParserArrowValidity(const CondParserArrowArray* array, int w, int count)
+    {
+        return array->validity != NULL ? condParserLoadBits(array->validity, array->offset + (int64_t)w * 64, count) : ~0ull;
+    }
+
+    // word w of a slot, from either kind of batch, null rows of Arrow columns read as false
+    static uint64_t condParserBatchColumn(const CondParserBatch* batch, const CondParserArrowBatch* arrow, unsigned slot, int w)
+    {
+        if (arrow == NULL) {
+            return batch->columns[slot][w];
+        }
+
+        const CondParserArrowArray* column = &arrow->columns[slot];
+        int count = condParserArrowCount(arrow, w);
+        uint64_t bits = condParserLoadBits((const unsigned char*)column->values, column->offset + (int64_t)w * 64, count);
+        return bits & condParserArrowValidity(column, w, count);
+    }
+
+    // values of a field for word w, the number of them and the mask of the valid ones
+    static const int32_t* condParserBatchField(const CondParserBatch* batch, const CondParserArrowBatch* arrow, unsigned field, int w, int* count, uint64_t* valid)
+    {
+        if (arrow == NULL) {
+            *count = 64;
+            *valid = ~0ull;
+            return batch->fields[field] + w * 64;
+        }
+
+        const CondParserArrowArray* array = &arrow->fields[field];
+        *count = condParserArrowCount(arrow, w);
+        *valid = condParserArrowValidity(array, w, *count);
+        return (const int32_t*)array->values + array->offset + (int64_t)w * 64;
+    }
+
+    static uint64_t condParserRangeWord(const int32_t* values, int count, uint32_t lo, uint32_t hi)
+    {
+        uint64_t result = 0;
+        int i = 0;
+#ifdef CONDPARSER_SSE2
+        // value - lo <= hi - lo as unsigned, using a signed compare of values biased by the sign bit
+        const __m128i bias = _mm_set1_epi32(INT32_MIN);
+        const __m128i first = _mm_set1_epi32((int32_t)lo);
+        const __m128i span = _mm_xor_si128(_mm_set1_epi32((int32_t)(hi - lo)), bias);
+        for (; i + 4 <= count; i += 4) {
+            __m128i offset = _mm_xor_si128(_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(values + i)), first), bias);
+            unsigned outside = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(offset, span)));
+            result |= (uint64_t)(~outside & 15) << i;
+        }
+#endif
+        for (; i < count; i++) {
+            result |= (uint64_t)condParserRangeHolds(values[i], lo, hi) << i;
+        }
+        return result;
+    }
+
+    static uint64_t condParserExecuteWord(const CondParserProgram* program, const CondParserBatch* batch, const CondParserArrowBatch* arrow, int w, bool checked)
+    {
+        uint64_t stack[CONDPARSER_STACK_SIZE];
+        int top = -1;
+
+        const unsigned char* pc = program->code;
+        const unsigned char* end = pc + program->size;
+
+        while (pc < end) {
+            CONDPARSER_CHECK(condParserInstructionSize(pc, end) != 0, 0);
+
+            unsigned op = *pc++;
+            switch (op)
+            {
+            case CondParserOp_Slot: {
+                unsigned slot = condParserReadU16(pc);
+                pc += 2;
+                CONDPARSER_CHECK(slot < (unsigned)program->numSlots && top + 1 < CONDPARSER_STACK_SIZE, 0);
+                stack[++top] = condParserBatchColumn(batch, arrow, slot, w);
+                break;
+            }
+            case CondParserOp_Not:
+                CONDPARSER_CHECK(top >= 0, 0);
+                stack[top] = ~stack[top];
+                break;
+            case CondParserOp_And:
+                CONDPARSER_CHECK(top >= 1, 0);
+                top--;
+                stack[top] &= stack[top + 1];
+                break;
+            case CondParserOp_Or:
+                CONDPARSER_CHECK(top >= 1, 0);
+                top--;
+                stack[top] |= stack[top + 1];
+                break;
+            case CondParserOp_Xor:
+                CONDPARSER_CHECK(top >= 1, 0);
+                top--;
+                stack[top] ^= stack[top + 1];
+                break;
+            case CondParserOp_Equal:
+                CONDPARSER_CHECK(top >= 1, 0);
+                top--;
+                stack[top] = ~(stack[top] ^ stack[top + 1]);
+                break;
+            case CondParserOp_Implies:
+                CONDPARSER_CHECK(top >= 1, 0);
+                top--;
+                stack[top] = ~stack[top] | stack[top + 1];
+                break;
+            case CondParserOp_Select:
+                CONDPARSER_CHECK(top >= 2, 0);
+                top -= 2;
+                stack[top] = (stack[top] & stack[top + 1]) | (~stack[top] & stack[top + 2]);
+                break;
+            case CondParserOp_JumpIfFalse: {
+                unsigned offset = condParserReadU16(pc);
+                pc += 2;
+                CONDPARSER_CHECK(top >= 0 && offset <= (unsigned)(end - pc), 0);
+                if (stack[top] == 0) {
+                    pc += offset;
+                }
+                break;
+            }
+            case CondParserOp_JumpIfTrue: {
+                unsigned offset = condParserReadU16(pc);
+                pc += 2;
+                CONDPARSER_CHECK(top >= 0 && offset <= (unsigned)(end - pc), 0);
+                if (stack[top] == ~0ull) {
+                    pc += offset;
+                }
+                break;
+            }
+            case CondParserOp_AtLeast:
+            case CondParserOp_AtMost:
+            case CondParserOp_Exactly: {
+                unsigned count = condParserReadU16(pc);
+                unsigned numStack = condParserReadU16(pc + 2);
+                unsigned numMasks = condParserReadU16(pc + 4);
+                pc += 6;
+                CONDPARSER_CHECK((int)numStack <= top + 1 && top + 1 - (int)numStack < CONDPARSER_STACK_SIZE, 0);
+
+                uint64_t planes[CONDPARSER_COUNT_PLANES] = { 0 };
+                for (unsigned i = 0; i < numStack; i++) {
+                    condParserCountAdd(planes, stack[top--]);
+                }
+                for (unsigned i = 0; i < numMasks; i++, pc += 10) {
+                    unsigned word = condParserReadU16(pc);
+                    uint64_t mask = condParserReadU64(pc + 2);
+                    while (mask != 0) {
+                        unsigned bit = (unsigned)condParserPopcount64((mask & (0 - mask)) - 1);
+                        CONDPARSER_CHECK(word * 64 + bit < (unsigned)program->numSlots, 0);
+                        condParserCountAdd(planes, condParserBatchColumn(batch, arrow, word * 64 + bit, w));
+                        mask &= mask - 1;
+                    }
+                }
+
+                stack[++top] = condParserCountCompare(op, planes, count);
+                break;
+            }
+            case CondParserOp_In: {
+                unsigned field = condParserReadU16(pc);
+                uint64_t mask = condParserReadU64(pc + 2);
+                pc += 10;
+                CONDPARSER_CHECK(field < (unsigned)program->numFields && top + 1 < CONDPARSER_STACK_SIZE, 0);
+
+                int count;
+                uint64_t valid;
+                const int32_t* values = condParserBatchField(batch, arrow, field, w, &count, &valid);
+
+                uint64_t result = 0;
+                for (int i = 0; i < count; i++) {
+                    uint32_t value = (uint32_t)values[i];
+                    result |= (uint64_t)(value < 64 && ((mask >> value) & 1)) << i;
+                }
+                stack[++top] = result & valid;
+                break;
+            }
+            case CondParserOp_Range: {
+                unsigned field = condParserReadU16(pc);
+                uint32_t lo = condParserReadU32(pc + 2);
+                uint32_t hi = condParserReadU32(pc + 6);
+                pc += 10;
+                CONDPARSER_CHECK(field < (unsigned)program->numFields && top + 1 < CONDPARSER_STACK_SIZE, 0);
+
+                int count;
+                uint64_t valid;
+                const int32_t* values = condParserBatchField(batch, arrow, field, w, &count, &valid);
+                stack[++top] = condParserRangeWord(values, count, lo, hi) & valid;
+                break;
+            }
+            case CondParserOp_False:
+                CONDPARSER_CHECK(top + 1 < CONDPARSER_STACK_SIZE, 0);
+                stack[++top] = 0;
+                break;
+            case CondParserOp_True:
+                CONDPARSER_CHECK(top + 1 < CONDPARSER_STACK_SIZE, 0);
+                stack[++top] = ~0ull;
+                break;
+            case CondParserOp_Table: {
+                unsigned numSlots = condParserReadU16(pc);
+                uint64_t table = condParserReadU64(pc + 2 + numSlots * 2);
+                CONDPARSER_CHECK(top + 1 < CONDPARSER_STACK_SIZE, 0);
+
+                // Shannon expansion: each slot selects between the halves of the remaining table
+                uint64_t lanes[1 << CONDPARSER_TABLE_SLOTS];
+                for (unsigned i = 0; i < (1u << numSlots); i++) {
+                    lanes[i] = 0 - ((table >> i) & 1);
+                }
+                for (unsigned j = 0; j < numSlots; j++) {
+                    unsigned slot = condParserReadU16(pc + 2 + j * 2);
+                    CONDPARSER_CHECK(slot < (unsigned)program->numSlots, 0);
+                    uint64_t column = condParserBatchColumn(batch, arrow, slot, w);
+                    for (unsigned i = 0; i < (1u << (numSlots - 1 - j)); i++) {
+                        lanes[i] = (column & lanes[2 * i + 1]) | (~column & lanes[2 * i]);
+                    }
+                }
+                stack[++top] = lanes[0];
+                pc += 10 + numSlots * 2;
+                break;
+            }
+            }
+        }
+
+        CONDPARSER_CHECK(top == 0, 0);
+        return top >= 0 ? stack[top] : 0;
+    }
+
+    // known bits of a slot for word w, arrow columns are known where they are valid
+    static uint64_t condParserKnownColumn(const CondParserArrowBatch* arrow, const CondParserKnown* known, unsigned slot, int w)
+    {
+        if (arrow != NULL) {
+            return condParserArrowValidity(&arrow->columns[slot], w, condParserArrowCount(arrow, w));
+        }
+        return known && known->columns && known->columns[slot] ? known->columns[slot][w] : ~0ull;
+    }
+
+    // evaluates word w under Kleene logic, each value being the planes of the definitely true and definitely false
+    // environments, returns the first and stores the second in isFalse
+    static uint64_t condParserExecuteKleeneWord(const CondParserProgram* program, const CondParserBatch* batch, const CondParserArrowBatch* arrow,
+        const CondParserKnown* known, int w, bool checked, uint64_t* isFalse)
+    {
+        uint64_t stackTrue[CONDPARSER_STACK_SIZE];
+        uint64_t stackFalse[CONDPARSER_STACK_SIZE];
+        int top = -1;
+
+        const unsigned char* pc = program->code;
+        const unsigned char* end = pc + program->size;
+        *isFalse = 0;
+
+        while (pc < end) {
+            CONDPARSER_CHECK(condParserInstructionSize(pc, end) != 0, 0);
+
+            unsigned op = *pc++;
+            switch (op)
+            {
+            case CondParserOp_Slot: {
+                unsigned slot = condParserReadU16(pc);
+                pc += 2;
+                CONDPARSER_CHECK(slot < (unsigned)program->numSlots && top + 1 < CONDPARSER_STACK_SIZE, 0);
+                uint64_t value = condParserBatchColumn(batch, arrow, slot, w);
+                uint64_t isKnown = condParserKnownColumn(arrow, known, slot, w);
+                top++;
+                stackTrue[top] = value & isKnown;
+                stackFalse[top] = ~value & isKnown;
+                break;
+            }
+            case CondParserOp_Not: {
+                CONDPARSER_CHECK(top >= 0, 0);
+                uint64_t t = stackTrue[top];
+                stackTrue[top] = stackFalse[top];
+                stackFalse[top] = t;
+                break;
+            }
+            case CondParserOp_And:
+                CONDPARSER_CHECK(top >= 1, 0);
+                top--;
+                stackTrue[top] &= stackTrue[top + 1];
+                stackFalse[top] |= stackFalse[top + 1];
+                break;
+            case CondParserOp_Or:
+                CONDPARSER_CHECK(top >= 1, 0);
+                top--;
+                stackTrue[top] |= stackTrue[top + 1];
+                stackFalse[top] &= stackFalse[top + 1];
+                break;
+            case CondParserOp_Xor:
+            case CondParserOp_Equal: {
+                CONDPARSER_CHECK(top >= 1, 0);
+                top--;
+                uint64_t differ = (stackTrue[top] & stackFalse[top + 1]) | (stackFalse[top] & stackTrue[top + 1]);
+                uint64_t same = (stackTrue[top] & stackTrue[top + 1]) | (stackFalse[top] & stackFalse[top + 1]);
+                stackTrue[top] = op == CondParserOp_Xor ? differ : same;
+                stackFalse[top] = op == CondParserOp_Xor ? same : differ;
+                break;
+            }
+            case CondParserOp_Implies: {
+                CONDPARSER_CHECK(top >= 1, 0);
+                top--;
+                uint64_t t = stackFalse[top] | stackTrue[top + 1];
+                stackFalse[top] = stackTrue[top] & stackFalse[top + 1];
+                stackTrue[top] = t;
+                break;
+            }
+            case CondParserOp_Select: {
+                // an unknown condition still gives a known result where both branches agree
+                CONDPARSER_CHECK(top >= 2, 0);
+                top -= 2;
+                uint64_t t = (stackTrue[top] & stackTrue[top + 1]) | (stackFalse[top] & stackTrue[top + 2]) | (stackTrue[top + 1] & stackTrue[top + 2]);
+                stackFalse[top] = (stackTrue[top] & stackFalse[top + 1]) | (stackFalse[top] & stackFalse[top + 2]) | (stackFalse[top + 1] & stackFalse[top + 2]);
+                stackTrue[top] = t;
+                break;
+            }
+            case CondParserOp_JumpIfFalse:
+            case CondParserOp_JumpIfTrue: {
+                unsigned offset = condParserReadU16(pc);
+                pc += 2;
+                CONDPARSER_CHECK(top >= 0 && offset <= (unsigned)(end - pc), 0);
+                // only a chain decided for every environment is skipped
+                if ((op == CondParserOp_JumpIfFalse ? stackFalse[top] : stackTrue[top]) == ~0ull) {
+                    pc += offset;
+                }
+                break;
+            }
+            case CondParserOp_AtLeast:
+            case CondParserOp_AtMost:
+            case CondParserOp_Exactly: {
+                unsigned count = condParserReadU16(pc);
+                unsigned numStack = condParserReadU16(pc + 2);
+                unsigned numMasks = condParserReadU16(pc + 4);
+                pc += 6;
+                CONDPARSER_CHECK((int)numStack <= top + 1 && top + 1 - (int)numStack < CONDPARSER_STACK_SIZE, 0);
+
+                // the number of true operands lies between the definitely and the possibly true ones
+                uint64_t definitely[CONDPARSER_COUNT_PLANES] = { 0 };
+                uint64_t possibly[CONDPARSER_COUNT_PLANES] = { 0 };
+                for (unsigned i = 0; i < numStack; i++, top--) {
+                    condParserCountAdd(definitely, stackTrue[top]);
+                    condParserCountAdd(possibly, ~stackFalse[top]);
+                }
+                for (unsigned i = 0; i < numMasks; i++, pc += 10) {
+                    unsigned word = condParserReadU16(pc);
+                    uint64_t mask = condParserReadU64(pc + 2);
+                    while (mask != 0) {
+                        unsigned bit = (unsigned)condParserPopcount64((mask & (0 - mask)) - 1);
+                        CONDPARSER_CHECK(word * 64 + bit < (unsigned)program->numSlots, 0);
+                        uint64_t value = condParserBatchColumn(batch, arrow, word * 64 + bit, w);
+                        uint64_t isKnown = condParserKnownColumn(arrow, known, word * 64 + bit, w);
+                        condParserCountAdd(definitely, value & isKnown);
+                        condParserCountAdd(possibly, value | ~isKnown);
+                        mask &= mask - 1;
+                    }
+                }
+
+                top++;
+                if (op == CondParserOp_AtLeast) {
+                    stackTrue[top] = condParserCountCompare(op, definitely, count);
+                    stackFalse[top] = ~condParserCountCompare(op, possibly, count);
+                }
+                else if (op == CondParserOp_AtMost) {
+                    stackTrue[top] = condParserCountCompare(op, possibly, count);
+                    stackFalse[top] = ~condParserCountCompare(op, definitely, count);
+                }
+                else {
+                    stackTrue[top] = condParserCountCompare(op, definitely, count) & condParserCountCompare(op, possibly, count);
+                    stackFalse[top] = ~condParserCountCompare(CondParserOp_AtMost, definitely, count) | ~condParserCountCompare(CondParserOp_AtLeast, possibly, count);
+                }
+                break;
+            }
+            case CondParserOp_In:
+            case CondParserOp_Range: {
+                unsigned field = condParserReadU16(pc);
+                CONDPARSER_CHECK(field < (unsigned)program->numFields && top + 1 < CONDPARSER_STACK_SIZE, 0);
+
+                int count;
+                uint64_t valid;
+                const int32_t* values = condParserBatchField(batch, arrow, field, w, &count, &valid);
+                if (arrow == NULL && known && known->fields && known->fields[field]) {
+                    valid &= known->fields[field][w];
+                }
+
+                uint64_t hits = 0;
+                if (op == CondParserOp_In) {
+                    uint64_t mask = condParserReadU64(pc + 2);
+                    for (int i = 0; i < count; i++) {
+                        uint32_t value = (uint32_t)values[i];
+                        hits |= (uint64_t)(value < 64 && ((mask >> value) & 1)) << i;
+                    }
+                }
+                else {
+                    hits = condParserRangeWord(values, count, condParserReadU32(pc + 2), condParserReadU32(pc + 6));
+                }
+                pc += 10;
+
+                top++;
+                stackTrue[top] = hits & valid;
+                stackFalse[top] = ~hits & valid;
+                break;
+            }
+            case CondParserOp_False:
+            case CondParserOp_True:
+                CONDPARSER_CHECK(top + 1 < CONDPARSER_STACK_SIZE, 0);
+                top++;
+                stackTrue[top] = op == CondParserOp_True ? ~0ull : 0;
+                stackFalse[top] = ~stackTrue[top];
+                break;
+            case CondParserOp_Table: {
+                unsigned numSlots = condParserReadU16(pc);
+                uint64_t table = condParserReadU64(pc + 2 + numSlots * 2);
+                CONDPARSER_CHECK(top + 1 < CONDPARSER_STACK_SIZE, 0);
+
+                // Shannon expansion as in condParserExecuteWord, an unknown slot keeping what both halves agree on
+                uint64_t lanesTrue[1 << CONDPARSER_TABLE_SLOTS];
+                uint64_t lanesFalse[1 << CONDPARSER_TABLE_SLOTS];
+                for (unsigned i = 0; i < (1u << numSlots); i++) {
+                    lanesTrue[i] = 0 - ((table >> i) & 1);
+                    lanesFalse[i] = ~lanesTrue[i];
+                }
+                for (unsigned j = 0; j < numSlots; j++) {
+                    unsigned slot = condParserReadU16(pc + 2 + j * 2);
+                    CONDPARSER_CHECK(slot < (unsigned)program->numSlots, 0);
+                    uint64_t value = condParserBatchColumn(batch, arrow, slot, w);
+                    uint64_t isKnown = condParserKnownColumn(arrow, known, slot, w);
+                    uint64_t one = value & isKnown;
+                    uint64_t zero = ~value & isKnown;
+                    for (unsigned i = 0; i < (1u << (numSlots - 1 - j)); i++) {
+                        lanesTrue[i] = (one & lanesTrue[2 * i + 1]) | (zero & lanesTrue[2 * i]) | (lanesTrue[2 * i + 1] & lanesTrue[2 * i]);
+                        lanesFalse[i] = (one & lanesFalse[2 * i + 1]) | (zero & lanesFalse[2 * i]) | (lanesFalse[2 * i + 1] & lanesFalse[2 * i]);
+                    }
+                }
+                top++;
+                stackTrue[top] = lanesTrue[0];
+                stackFalse[top] = lanesFalse[0];
+                pc += 10 + numSlots * 2;
+                break;
+            }
+            }
+        }
+
+        CONDPARSER_CHECK(top == 0, 0);
+        *isFalse = top >= 0 ? stackFalse[top] : 0;
+        return top >= 0 ? stackTrue[top] : 0;
+    }
+
+#undef CONDPARSER_CHECK
+
+    void condParserExecuteBatch(const CondParserProgram* program, const CondParserBatch* batch, uint64_t* results)
+    {
+        if (program->verified) {
+            for (int w = 0; w < batch->numWords; w++) {
+                results[w] = condParserExecuteWord(program, batch, NULL, w, false);
+            }
+        }
+        else {
+            for (int w = 0; w < batch->numWords; w++) {
+                results[w] = condParserExecuteWord(program, batch, NULL, w, true);
+            }
+        }
+    }
+
+    void condParserExecuteKleene(const CondParserProgram* program, const CondParserBatch* batch, const CondParserKnown* known, uint64_t* resultTrue, uint64_t* resultFalse, uint64_t* resultUnknown)
+    {
+        for (int w = 0; w < batch->numWords; w++) {
+            resultTrue[w] = condParserExecuteKleeneWord(program, batch, NULL, known, w, !program->verified, &resultFalse[w]);
+            if (resultUnknown != NULL) {
+                resultUnknown[w] = ~(resultTrue[w] | resultFalse[w]);
+            }
+        }
+    }
+
+    // adds the slots and fields a program reads from words [first, first + numWords) of its slots and fields to
+    // bitsets of numWords words, bit 0 of slots[0] being slot first * 64, fields may be NULL
+    static void condParserAddOperandsIn(const CondParserProgram* program, unsigned first, unsigned numWords, uint64_t* slots, uint64_t* fields)
+    {
+        // out of range operands of unverified programs are left out, executing them fails anyway
+        unsigned numSlots = (unsigned)program->numSlots;
+        const unsigned char* pc = program->code;
+        const unsigned char* end = pc + program->size;
+        int size;
+        for (; pc < end && (size = condParserInstructionSize(pc, end)) != 0; pc += size) {
+            if (*pc == CondParserOp_Slot) {
+                unsigned slot = condParserReadU16(pc + 1);
+                if (slot < numSlots && (slot >> 6) - first < numWords) {
+                    slots[(slot >> 6) - first] |= 1ull << (slot & 63);
+                }
+            }
+            else if (fields && (*pc == CondParserOp_In || *pc == CondParserOp_Range)) {
+                unsigned field = condParserReadU16(pc + 1);
+                if (field < (unsigned)program->numFields && (field >> 6) - first < numWords) {
+                    fields[(field >> 6) - first] |= 1ull << (field & 63);
+                }
+            }
+            else if (*pc == CondParserOp_Table) {
+                for (unsigned j = 0; j < condParserReadU16(pc + 1); j++) {
+                    unsigned slot = condParserReadU16(pc + 3 + j * 2);
+                    if (slot < numSlots && (slot >> 6) - first < numWords) {
+                        slots[(slot >> 6) - first] |= 1ull << (slot & 63);
+                    }
+                }
+            }
+            else if (*pc == CondParserOp_AtLeast || *pc == CondParserOp_AtMost || *pc == CondParserOp_Exactly) {
+                for (unsigned i = 0; i < condParserReadU16(pc + 5); i++) {
+                    unsigned word = condParserReadU16(pc + 7 + i * 10);
+                    if (word < (numSlots + 63) >> 6 && word - first < numWords) {
+                        uint64_t inRange = numSlots - word * 64 < 64 ? (1ull << (numSlots - word * 64)) - 1 : ~0ull;
+                        slots[word - first] |= condParserReadU64(pc + 9 + i * 10) & inRange;
+                    }
+                }
+            }
+        }
+    }
+
+    // adds the slots and fields a program reads to bitsets of (program->numSlots + 63) / 64 and
+    // (program->numFields + 63) / 64 words, fields may be NULL
+    static void condParserAddOperands(const CondParserProgram* program, uint64_t* slots, uint64_t* fields)
+    {
+        condParserAddOperandsIn(program, 0, 0x10000 >> 6, slots, fields);
+    }
+
+    // marks on the stack of condParserExecuteArrow, larger programs are marked a window at a time
+#define CONDPARSER_MARK_WORDS 16
+
+    // clears and marks the operands of window first, CONDPARSER_MARK_WORDS words of slots and of fields
+    static void condParserMarkOperands(const CondParserProgram* program, unsigned first, uint64_t* slots, uint64_t* fields)
+    {
+        for (int w = 0; w < CONDPARSER_MARK_WORDS; w++) {
+            slots[w] = 0;
+            fields[w] = 0;
+        }
+        condParserAddOperandsIn(program, first, CONDPARSER_MARK_WORDS, slots, fields);
+    }
+
+    // AND of the validity of the marked arrays over word w, marked covering numArrays arrays from window first on
+    static uint64_t condParserMarkedValidity(const CondParserArrowArray* arrays, const uint64_t* marked, unsigned first, int numArrays, int w, int count)
+    {
+        uint64_t valid = ~0ull;
+        for (int m = 0; m < CONDPARSER_MARK_WORDS && (int)(first + m) * 64 < numArrays; m++) {
+            for (uint64_t bits = marked[m]; bits != 0; bits &= bits - 1) {
+                valid &= condParserArrowValidity(&arrays[(first + m) * 64 + condParserPopcount64((bits & (0 - bits)) - 1)], w, count);
+            }
+        }
+        return valid;
+    }
+
+    static void condParserStoreBits(unsigned char* bitmap, int w, uint64_t bits, int count)
+    {
+        for (int i = 0; i < (count + 7) >> 3; i++) {
+            bitmap[(int64_t)w * 8 + i] = (unsigned char)(bits >> (i * 8));
+        }
+    }
+
+    void condParserExecuteArrow(const CondParserProgram* program, const CondParserArrowBatch* batch, CondParserNulls nulls, uint8_t* result, uint8_t* resultValidity)
+    {
+        uint64_t slots[CONDPARSER_MARK_WORDS];
+        uint64_t fields[CONDPARSER_MARK_WORDS];
+        bool unknown = nulls == CondParserNulls_Unknown;
+        int numOperandWords = ((program->numSlots > program->numFields ? program->numSlots : program->numFields) + 63) >> 6;
+        if (unknown && numOperandWords <= CONDPARSER_MARK_WORDS) {
+            condParserMarkOperands(program, 0, slots, fields);
+        }
+
+        int numWords = (int)((batch->length + 63) / 64);
+        for (int w = 0; w < numWords; w++) {
+            int count = condParserArrowCount(batch, w);
+            uint64_t valid = count < 64 ? (1ull << count) - 1 : ~0ull;
+
+            if (nulls == CondParserNulls_Kleene) {
+                uint64_t isFalse;
+                uint64_t isTrue = condParserExecuteKleeneWord(program, NULL, batch, NULL, w, !program->verified, &isFalse);
+                if (resultValidity != NULL) {
+                    condParserStoreBits(resultValidity, w, (isTrue | isFalse) & valid, count);
+                }
+                condParserStoreBits(result, w, isTrue & valid, count);
+                continue;
+            }
+
+            uint64_t bits = condParserExecuteWord(program, NULL, batch, w, !program->verified);
+            if (unknown) {
+                for (unsigned first = 0; first < (unsigned)numOperandWords; first += CONDPARSER_MARK_WORDS) {
+                    if (numOperandWords > CONDPARSER_MARK_WORDS) {
+                        condParserMarkOperands(program, first, slots, fields);
+                    }
+                    valid &= condParserMarkedValidity(batch->columns, slots, first, program->numSlots, w, count);
+                    valid &= condParserMarkedValidity(batch->fields, fields, first, program->numFields, w, count);
+                }
+                if (resultValidity != NULL) {
+                    condParserStoreBits(resultValidity, w, valid, count);
+                }
+            }
+            condParserStoreBits(result, w, bits & valid, count);
+        }
+    }
+
+#undef CONDPARSER_MARK_WORDS
+
+#ifdef CONDPARSER_SSE2
+    // transposes a 64x64 bit matrix, bit i of out[b] is bit b of in[i * stride]: bytes are transposed 16 rows at a
+    // time with unpacks, then movemask peels one bit of each row per instruction
+    static void condParserTranspose64(const uint64_t* in, size_t stride, uint64_t* out)
+    {
+        // 16 bit parts of the output words, lowest part first
+        uint16_t parts[64][4];
+
+        for (int g = 0; g < 4; g++) {
+            __m128i a[16];
+            __m128i t[8];
+            for (int i = 0; i < 16; i++) {
+                a[i] = _mm_loadl_epi64((const __m128i*)(in + (size_t)(g * 16 + i) * stride));
+            }
+
+            for (int i = 0; i < 8; i++) {
+                t[i] = _mm_unpacklo_epi8(a[i], a[i + 8]);
+            }
+            for (int i = 0; i < 4; i++) {
+                a[i] = _mm_unpacklo_epi8(t[i], t[i + 4]);
+                a[i + 4] = _mm_unpackhi_epi8(t[i], t[i + 4]);
+            }
+            for (int i = 0; i < 4; i++) {
+                int j = i + (i & 2);
+                t[j] = _mm_unpacklo_epi8(a[j], a[j + 2]);
+                t[j + 2] = _mm_unpackhi_epi8(a[j], a[j + 2]);
+            }
+            for (int j = 0; j < 8; j += 2) {
+                a[j] = _mm_unpacklo_epi8(t[j], t[j + 1]);
+                a[j + 1] = _mm_unpackhi_epi8(t[j], t[j + 1]);
+            }
+
+            // a[k] holds byte k of the 16 rows in order
+            for (int k = 0; k < 8; k++) {
+                __m128i x = a[k];
+                for (int b = 7; b >= 0; b--) {
+                    parts[k * 8 + b][g] = (uint16_t)_mm_movemask_epi8(x);
+                    x = _mm_slli_epi64(x, 1);
+                }
+            }
+        }
+
+        for (int b = 0; b < 64; b++) {
+            out[b] = (uint64_t)parts[b][0] | (uint64_t)parts[b][1] << 16 | (uint64_t)parts[b][2] << 32 |
+                     (uint64_t)parts[b][3] << 48;
+        }
+    }
+#else
+    // transposes a 64x64 bit matrix, bit i of out[b] is bit b of in[i * stride]: swaps ever smaller blocks
+    static void condParserTranspose64(const uint64_t* in, size_t stride, uint64_t* out)
+    {
+        for (int i = 0; i < 64; i++) {
+            out[i] = in[(size_t)i * stride];
+        }
+
+        uint64_t m = 0x00000000ffffffffull;
+        for (int j = 32; j != 0; j >>= 1, m ^= m << j) {
+            for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+                uint64_t t = ((out[k] >> j) ^ out[k | j]) & m;
+                out[k] ^= t << j;
+                out[k | j] ^= t;
+            }
+        }
+    }
+#endif
+
+
+    // columns are written a cache line at a time, they are usually a multiple of 4KB apart and would evict each other
+#define CONDPARSER_TRANSPOSE_BLOCKS 8
+
+    void condParserTransposeRows(const uint64_t* rows, int rowWords, int numEnvs, uint64_t* columns, int numSlots)
+    {
+        int numWords = (numEnvs + 63) / 64;
+        uint64_t block[64];
+        uint64_t out[CONDPARSER_TRANSPOSE_BLOCKS][64];
+
+        for (int w0 = 0; w0 < numWords; w0 += CONDPARSER_TRANSPOSE_BLOCKS) {
+            int numBlocks = numWords - w0 < CONDPARSER_TRANSPOSE_BLOCKS ? numWords - w0 : CONDPARSER_TRANSPOSE_BLOCKS;
+
+            for (int j = 0; j * 64 < numSlots; j++) {
+                for (int k = 0; k < numBlocks; k++) {
+                    int w = w0 + k;
+                    int count = numEnvs - w * 64 < 64 ? numEnvs - w * 64 : 64;
+                    const uint64_t* in = rows + (size_t)w * 64 * rowWords + j;
+                    size_t stride = (size_t)rowWords;
+
+                    // the last environments are padded with zeroes
+                    if (count < 64) {
+                        for (int i = 0; i < 64; i++) {
+                            block[i] = i < count ? in[(size_t)i * rowWords] : 0;
+                        }
+                        in = block;
+                        stride = 1;
+                    }
+
+                    condParserTranspose64(in, stride, out[k]);
+                }
+
+                int n = numSlots - j * 64 < 64 ? numSlots - j * 64 : 64;
+                for (int b = 0; b < n; b++) {
+                    uint64_t* column = columns + (size_t)(j * 64 + b) * numWords + w0;
+                    for (int k = 0; k < numBlocks; k++) {
+                        column[k] = out[k][b];
+                    }
+                }
+            }
+        }
+    }
+
+    void condParserTransposeColumns(const uint64_t* columns, int numSlots, int numEnvs, uint64_t* rows, int rowWords)
+    {
+        int numWords = (numEnvs + 63) / 64;
+        uint64_t block[64][CONDPARSER_TRANSPOSE_BLOCKS];
+        uint64_t out[64];
+
+        for (int w0 = 0; w0 < numWords; w0 += CONDPARSER_TRANSPOSE_BLOCKS) {
+            int numBlocks = numWords - w0 < CONDPARSER_TRANSPOSE_BLOCKS ? numWords - w0 : CONDPARSER_TRANSPOSE_BLOCKS;
+
+            for (int j = 0; j * 64 < numSlots; j++) {
+                // missing slots of the last row word read as zeroes
+                int n = numSlots - j * 64 < 64 ? numSlots - j * 64 : 64;
+                for (int b = 0; b < 64; b++) {
+                    const uint64_t* column = columns + (size_t)(j * 64 + b) * numWords + w0;
+                    for (int k = 0; k < numBlocks; k++) {
+                        block[b][k] = b < n ? column[k] : 0;
+                    }
+                }
+
+                for (int k = 0; k < numBlocks; k++) {
+                    int w = w0 + k;
+                    int count = numEnvs - w * 64 < 64 ? numEnvs - w * 64 : 64;
+
+                    condParserTranspose64(&block[0][k], CONDPARSER_TRANSPOSE_BLOCKS, out);
+
+                    for (int i = 0; i < count; i++) {
+                        rows[(size_t)(w * 64 + i) * rowWords + j] = out[i];
+                    }
+                }
+            }
+        }
+    }
+
+#undef CONDPARSER_TRANSPOSE_BLOCKS
+
+    bool condParserProjectionMask(const CondParserProgram* program, uint64_t* mask)
+    {
+        condParserAddOperands(program, mask, NULL);
+
+        // rows only hold slots, rows differing in a field the program reads must not share a result
+        const unsigned char* pc = program->code;
+        const unsigned char* end = pc + program->size;
+        int size;
+        for (; pc < end && (size = condParserInstructionSize(pc, end)) != 0; pc += size) {
+            if (*pc == CondParserOp_In || *pc == CondParserOp_Range) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static uint64_t condParserHashMasked(const uint64_t* mask, const uint64_t* row, int numWords)
+    {
+        uint64_t hash = 0x9e3779b97f4a7c15ull;
+        for (int w = 0; w < numWords; w++) {
+            hash = (hash ^ (row[w] & mask[w])) * 0xff51afd7ed558ccdull;
+            hash ^= hash >> 32;
+        }
+        return hash;
+    }
+
+    static bool condParserEqualMasked(const uint64_t* mask, const uint64_t* a, const uint64_t* b, int numWords)
+    {
+        for (int w = 0; w < numWords; w++) {
+            if ((a[w] ^ b[w]) & mask[w]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int condParserDedupRows(const uint64_t* mask, int maskWords, const uint64_t* rows, int rowWords, int numEnvs, CondParserDedup* dedup)
+    {
+        int numWords = maskWords < rowWords ? maskWords : rowWords;
+        int bucketMask = dedup->capacity - 1;
+        for (int i = 0; i < dedup->capacity; i++) {
+            dedup->buckets[i] = -1;
+        }
+
+        dedup->numGroups = 0;
+        for (int e = 0; e < numEnvs; e++) {
+            const uint64_t* row = rows + (size_t)e * rowWords;
+            int i = (int)(condParserHashMasked(mask, row, numWords) & (uint64_t)bucketMask);
+
+            for (int probe = 0;; probe++, i = (i + 1) & bucketMask) {
+                if (probe == dedup->capacity) {
+                    return -1;
+                }
+
+                int g = dedup->buckets[i];
+                if (g < 0) {
+                    g = dedup->numGroups++;
+                    dedup->buckets[i] = g;
+                    dedup->representatives[g] = e;
+                }
+                else if (!condParserEqualMasked(mask, row, rows + (size_t)dedup->representatives[g] * rowWords, numWords)) {
+                    continue;
+                }
+
+                dedup->groups[e] = g;
+                break;
+            }
+        }
+
+        return dedup->numGroups;
+    }
+
+    void condParserScatterGroups(const CondParserDedup* dedup, int numEnvs, const uint64_t* groupResults, uint64_t* results)
+    {
+        for (int w = 0; w < (numEnvs + 63) >> 6; w++) {
+            uint64_t word = 0;
+            for (int i = 0; i < 64 && w * 64 + i < numEnvs; i++) {
+                int g = dedup->groups[w * 64 + i];
+                word |= ((groupResults[g >> 6] >> (g & 63)) & 1) << i;
+            }
+            results[w] = word;
+        }
+    }
+
+    // words of a truth table over CONDPARSER_ANALYSIS_SLOTS slots
+#define CONDPARSER_TABLE_WORDS ((1 << CONDPARSER_ANALYSIS_SLOTS) > 64 ? (1 << CONDPARSER_ANALYSIS_SLOTS) / 64 : 1)
+
+    static bool condParserAddSupport(int* slots, int* numSlots, int slot)
+    {
+        int i = *numSlots;
+        while (i > 0 && slots[i - 1] > slot) i--;
+        if (i > 0 && slots[i - 1] == slot) {
+            return true;
+        }
+        if (*numSlots == CONDPARSER_ANALYSIS_SLOTS) {
+            return false;
+        }
+
+        for (int k = *numSlots; k > i; k--) {
+            slots[k] = slots[k - 1];
+        }
+        slots[i] = slot;
+        (*numSlots)++;
+        return true;
+    }
+
+    // collects the slots a program reads in ascending order, returns their number
+    // or -1 if the program reads fields, is malformed or reads more than CONDPARSER_ANALYSIS_SLOTS slots
+    static int condParserSupport(const CondParserProgram* program, int* slots)
+    {
+        int numSlots = 0;
+        const unsigned char* pc = program->code;
+        const unsigned char* end = pc + program->size;
+
+        while (pc < end) {
+            int size = condParserInstructionSize(pc, end);
+            if (size == 0 || *pc == CondParserOp_In || *pc == CondParserOp_Range) {
+                return -1;
+            }
+
+            if (*pc == CondParserOp_Slot && !condParserAddSupport(slots, &numSlots, (int)condParserReadU16(pc + 1))) {
+                return -1;
+            }
+            for (int j = 0; *pc == CondParserOp_Table && j < (int)condParserReadU16(pc + 1); j++) {
+                if (!condParserAddSupport(slots, &numSlots, (int)condParserReadU16(pc + 3 + j * 2))) {
+                    return -1;
+                }
+            }
+            if (*pc == CondParserOp_AtLeast || *pc == CondParserOp_AtMost || *pc == CondParserOp_Exactly) {
+                for (int i = 0; i < (int)condParserReadU16(pc + 5); i++) {
+                    int word = (int)condParserReadU16(pc + 7 + i * 10);
+                    for (uint64_t mask = condParserReadU64(pc + 9 + i * 10); mask != 0; mask &= mask - 1) {
+                        int bit = condParserPopcount64((mask & (0 - mask)) - 1);
+                        if (!condParserAddSupport(slots, &numSlots, word * 64 + bit)) {
+                            return -1;
+                        }
+                    }
+                }
+            }
+            pc += size;
+        }
+
+        return numSlots;
+    }
+
+    static bool condParserTableBit(const uint64_t* table, int i)
+    {
+        return (table[i >> 6] >> (i & 63)) & 1;
+    }
+
+    // evaluates a program for every assignment of the given slots, all other slots being false
+    // bit i of the table holds the result for the assignment whose bit j sets slots[j]
+    static void condParserTruthTable(const CondParserProgram* program, const int* slots, int numSlots, uint64_t* table)
+    {
+        uint64_t bits[1024]; // enough for all 0x10000 slots
+        int numWords = program->numSlots < 0x10000 ? (program->numSlots + 63) >> 6 : 1024;
+        if (numSlots > 0 && slots[numSlots - 1] >= numWords * 64) {
+            // slots of other rules grouped with this one, the program doesn't read them
+            numWords = (slots[numSlots - 1] >> 6) + 1;
+        }
+        for (int w = 0; w < numWords; w++) {
+            bits[w] = 0;
+        }
+
+        const CondParserEnv env = { bits, NULL };
+        int size = 1 << numSlots;
+        for (int w = 0; w < (size + 63) >> 6; w++) {
+            table[w] = 0;
+        }
+
+        for (int i = 0; i < size; i++) {
+            for (int j = 0; j < numSlots; j++) {
+                uint64_t bit = 1ull << (slots[j] & 63);
+                bits[slots[j] >> 6] = ((i >> j) & 1) ? (bits[slots[j] >> 6] | bit) : (bits[slots[j] >> 6] & ~bit);
+            }
+            table[i >> 6] |= (uint64_t)condParserExecute(program, &env) << (i & 63);
+        }
+    }
+
+    // drops the slots a truth table doesn't depend on and compacts the table, returns the number of slots left
+    static int condParserReduceTable(int* slots, int numSlots, uint64_t* table)
+    {
+        for (int j = numSlots - 1; j >= 0; j--) {
+            int size = 1 << numSlots;
+            bool depends = false;
+            for (int i = 0; i < size && !depends; i++) {
+                depends = !((i >> j) & 1) && condParserTableBit(table, i) != condParserTableBit(table, i | (1 << j));
+            }
+            if (depends) {
+                continue;
+            }
+
+            // keep the half with slot j false, entry n is written only after entry i >= n has been read
+            int n = 0;
+            for (int i = 0; i < size; i++) {
+                if (!((i >> j) & 1)) {
+                    uint64_t bit = 1ull << (n & 63);
+                    table[n >> 6] = condParserTableBit(table, i) ? (table[n >> 6] | bit) : (table[n >> 6] & ~bit);
+                    n++;
+                }
+            }
+
+            numSlots--;
+            for (int k = j; k < numSlots; k++) {
+                slots[k] = slots[k + 1];
+            }
+        }
+
+        // clear the bits past the end so tables compare word by word
+        if (numSlots < 6) {
+            table[0] &= ~(~0ull << (1 << numSlots));
+        }
+        return numSlots;
+    }
+
+    static uint64_t condParserMix(uint64_t hash, uint64_t value)
+    {
+        hash = (hash ^ value) * 0xff51afd7ed558ccdull;
+        return hash ^ (hash >> 32);
+    }
+
+    // merges two sorted slot lists, fails if the union is too large to analyse
+    static int condParserSupportUnion(const int* a, int numA, const int* b, int numB, int* slots)
+    {
+        int numSlots = 0;
+        for (int i = 0; i < numA; i++) {
+            condParserAddSupport(slots, &numSlots, a[i]);
+        }
+        for (int i = 0; i < numB; i++) {
+            if (!condParserAddSupport(slots, &numSlots, b[i])) {
+                return -1;
+            }
+        }
+        return numSlots;
+    }
+
+    static void condParserSetRowBit(uint64_t* row, int r)
+    {
+        row[r >> 6] |= 1ull << (r & 63);
+    }
+
+    // fills the settle matrices and the evaluation order of a ruleset whose rules have been analysed
+    static void condParserAnalyzeImplications(CondParserRuleset* ruleset, int budget)
+    {
+        uint64_t table[CONDPARSER_TABLE_WORDS];
+        uint64_t other[CONDPARSER_TABLE_WORDS];
+        int numRules = ruleset->numRules;
+        int numWords = (numRules + 63) >> 6;
+        CondParserRuleInfo* info = ruleset->info;
+
+        for (int i = 0; i < numRules * numWords; i++) {
+            ruleset->settleTrue[i] = 0;
+            ruleset->settleFalse[i] = 0;
+        }
+
+        // the full relation first: bit r of settleTrue row s and bit s of settleFalse row r if rule r implies rule s
+        for (int s = 0; s < numRules; s++) {
+            if (info[s].truth != CondParserTruth_Contingent || info[s].shared != s) {
+                continue;
+            }
+
+            int sSlots[CONDPARSER_ANALYSIS_SLOTS];
+            int numS = condParserSupport(&ruleset->rules[s], sSlots);
+
+            for (int r = 0; r < s; r++) {
+                if (info[r].truth != CondParserTruth_Contingent || info[r].shared != r) {
+                    continue;
+                }
+
+                int rSlots[CONDPARSER_ANALYSIS_SLOTS];
+                int both[CONDPARSER_ANALYSIS_SLOTS];
+                int numR = condParserSupport(&ruleset->rules[r], rSlots);
+                int numBoth = condParserSupportUnion(sSlots, numS, rSlots, numR, both);
+
+                // rules over disjoint slots can't imply each other unless one of them is constant
+                if (numBoth < 0 || numBoth == numS + numR || budget < (2 << numBoth)) {
+                    continue;
+                }
+                budget -= 2 << numBoth;
+
+                condParserTruthTable(&ruleset->rules[s], both, numBoth, table);
+                condParserTruthTable(&ruleset->rules[r], both, numBoth, other);
+
+                bool sImpliesR = true;
+                bool rImpliesS = true;
+                for (int w = 0; w < ((1 << numBoth) + 63) >> 6; w++) {
+                    sImpliesR = sImpliesR && (table[w] & ~other[w]) == 0;
+                    rImpliesS = rImpliesS && (other[w] & ~table[w]) == 0;
+                }
+
+                if (rImpliesS) {
+                    condParserSetRowBit(ruleset->settleTrue + s * numWords, r);
+                    condParserSetRowBit(ruleset->settleFalse + r * numWords, s);
+                }
+                if (sImpliesR) {
+                    condParserSetRowBit(ruleset->settleTrue + r * numWords, s);
+                    condParserSetRowBit(ruleset->settleFalse + s * numWords, r);
+                }
+            }
+        }
+
+        // evaluated rules come first, the ones related to most others leading, then constant and shared rules
+        int numOrdered = 0;
+        for (int r = 0; r < numRules; r++) {
+            if (info[r].shared != r || info[r].truth == CondParserTruth_Always || info[r].truth == CondParserTruth_Never) {
+                info[r].position = -1;
+                continue;
+            }
+
+            int degree = 0;
+            for (int w = 0; w < numWords; w++) {
+                degree += condParserPopcount64(ruleset->settleTrue[r * numWords + w]) + condParserPopcount64(ruleset->settleFalse[r * numWords + w]);
+            }
+            info[r].position = degree;
+
+            int i = numOrdered++;
+            while (i > 0 && info[ruleset->order[i - 1]].position < degree) {
+                ruleset->order[i] = ruleset->order[i - 1];
+                i--;
+            }
+            ruleset->order[i] = r;
+        }
+        for (int r = 0; r < numRules; r++) {
+            if (info[r].position < 0) {
+                ruleset->order[numOrdered++] = r;
+            }
+        }
+        for (int i = 0; i < numRules; i++) {
+            info[ruleset->order[i]].position = i;
+        }
+
+        // a rule can only be settled by rules evaluated before it
+        for (int s = 0; s < numRules; s++) {
+            for (int r = 0; r < numRules; r++) {
+                if (info[r].position >= info[s].position) {
+                    ruleset->settleTrue[s * numWords + (r >> 6)] &= ~(1ull << (r & 63));
+                    ruleset->settleFalse[s * numWords + (r >> 6)] &= ~(1ull << (r & 63));
+                }
+            }
+        }
+    }
+
+    int condParserAnalyzeRuleset(CondParserRuleset* ruleset, int budget)
+    {
+        uint64_t table[CONDPARSER_TABLE_WORDS];
+        uint64_t other[CONDPARSER_TABLE_WORDS];
+        int numEvaluated = 0;
+
+        for (int r = 0; r < ruleset->numRules; r++) {
+            const CondParserProgram* rule = &ruleset->rules[r];
+            CondParserRuleInfo* info = &ruleset->info[r];
+            info->truth = CondParserTruth_Unknown;
+            info->shared = r;
+            info->fingerprint = 0;
+            info->position = r;
+
+            int slots[CONDPARSER_ANALYSIS_SLOTS];
+            int numSlots = condParserSupport(rule, slots);
+            if (numSlots >= 0 && budget >= (1 << numSlots)) {
+                budget -= 1 << numSlots;
+                condParserTruthTable(rule, slots, numSlots, table);
+                numSlots = condParserReduceTable(slots, numSlots, table);
+
+                info->truth = numSlots > 0 ? CondParserTruth_Contingent : (table[0] & 1) ? CondParserTruth_Always : CondParserTruth_Never;
+                uint64_t fingerprint = condParserMix(0x9e3779b97f4a7c15ull, (uint64_t)numSlots);
+                for (int j = 0; j < numSlots; j++) {
+                    fingerprint = condParserMix(fingerprint, (uint64_t)slots[j]);
+                }
+                for (int w = 0; w < ((1 << numSlots) + 63) >> 6; w++) {
+                    fingerprint = condParserMix(fingerprint, table[w]);
+                }
+                info->fingerprint = fingerprint;
+            }
+
+            if (info->truth == CondParserTruth_Always || info->truth == CondParserTruth_Never) {
+                continue;
+            }
+
+            for (int e = 0; e < r; e++) {
+                const CondParserProgram* earlier = &ruleset->rules[e];
+                const CondParserRuleInfo* earlierInfo = &ruleset->info[e];
+                if (earlierInfo->shared != e || earlierInfo->truth != info->truth) {
+                    continue;
+                }
+
+                if (info->truth == CondParserTruth_Unknown) {
+                    // without a truth table only identical programs are known to be equivalent
+                    int i = 0;
+                    while (i < rule->size && earlier->size == rule->size && earlier->code[i] == rule->code[i]) i++;
+                    if (i == rule->size && earlier->size == rule->size) {
+                        info->shared = e;
+                        break;
+                    }
+                    continue;
+                }
+
+                if (earlierInfo->fingerprint != info->fingerprint) {
+                    continue;
+                }
+
+                // confirm over both programs' slots, so a hash collision can't merge different rules
+                int ruleSlots[CONDPARSER_ANALYSIS_SLOTS];
+                int earlierSlots[CONDPARSER_ANALYSIS_SLOTS];
+                int both[CONDPARSER_ANALYSIS_SLOTS];
+                int numBoth = condParserSupportUnion(ruleSlots, condParserSupport(rule, ruleSlots), earlierSlots, condParserSupport(earlier, earlierSlots), both);
+                if (numBoth < 0 || budget < (2 << numBoth)) {
+                    continue;
+                }
+                budget -= 2 << numBoth;
+
+                condParserTruthTable(rule, both, numBoth, table);
+                condParserTruthTable(earlier, both, numBoth, other);
+                int w = 0;
+                while (w < ((1 << numBoth) + 63) >> 6 && table[w] == other[w]) w++;
+                if (w == ((1 << numBoth) + 63) >> 6) {
+                    info->shared = e;
+                    break;
+                }
+            }
+
+            if (info->shared == r) {
+                numEvaluated++;
+            }
+        }
+
+        if (ruleset->order) {
+            condParserAnalyzeImplications(ruleset, budget);
+        }
+        return numEvaluated;
+    }
+
+#undef CONDPARSER_TABLE_WORDS
+
+    // whether any bit of a row is set in results (or clear, if negate)
+    static bool condParserRowAny(const uint64_t* row, const uint64_t* results, int numWords, bool negate)
+    {
+        for (int w = 0; w < numWords; w++) {
+            if (row[w] & (negate ? ~results[w] : results[w])) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the value of rule r given the results of the rules evaluated before it, or -1 if its program has to run
+    static int condParserSettledValue(const CondParserRuleset* ruleset, int r, const uint64_t* results)
+    {
+        int numWords = (ruleset->numRules + 63) >> 6;
+        const CondParserRuleInfo* info = &ruleset->info[r];
+
+        if (info->truth == CondParserTruth_Always || info->truth == CondParserTruth_Never) {
+            return info->truth == CondParserTruth_Always;
+        }
+        if (info->shared != r) {
+            return (results[info->shared >> 6] >> (info->shared & 63)) & 1;
+        }
+        if (ruleset->order && condParserRowAny(ruleset->settleTrue + r * numWords, results, numWords, false)) {
+            // implied by a rule that is true
+            return 1;
+        }
+        if (ruleset->order && condParserRowAny(ruleset->settleFalse + r * numWords, results, numWords, true)) {
+            // implies a rule that is false
+            return 0;
+        }
+        return -1;
+    }
+
+    int condParserExecuteRuleset(const CondParserRuleset* ruleset, const CondParserEnv* env, uint64_t* results)
+    {
+        int numWords = (ruleset->numRules + 63) >> 6;
+        for (int w = 0; w < numWords; w++) {
+            results[w] = 0;
+        }
+
+        int numExecuted = 0;
+        for (int i = 0; i < ruleset->numRules; i++) {
+            int r = ruleset->order ? ruleset->order[i] : i;
+
+            int value = condParserSettledValue(ruleset, r, results);
+            if (value < 0) {
+                value = condParserExecute(&ruleset->rules[r], env);
+                numExecuted++;
+            }
+
+            results[r >> 6] |= (uint64_t)value << (r & 63);
+        }
+
+        return numExecuted;
+    }
+
+    float condParserScoreRuleset(const CondParserRuleset* ruleset, const CondParserEnv* env, uint64_t* results)
+    {
+        condParserExecuteRuleset(ruleset, env, results);
+
+        float score = 0.0f;
+        for (int w = 0; w < (ruleset->numRules + 63) >> 6; w++) {
+            for (uint64_t bits = results[w]; bits != 0; bits &= bits - 1) {
+                score += ruleset->weights[w * 64 + condParserPopcount64((bits & (0 - bits)) - 1)];
+            }
+        }
+        return score;
+    }
+
+    // adds weight to the scores of the environments set in mask
+    static void condParserAddMasked(float* scores, uint64_t mask, float weight)
+    {
+#ifdef CONDPARSER_SSE2
+        const __m128i lanes = _mm_set_epi32(8, 4, 2, 1);
+        const __m128 weights = _mm_set1_ps(weight);
+        for (int i = 0; i < 64; i += 4, mask >>= 4) {
+            __m128i nibble = _mm_set1_epi32((int)(mask & 0xf));
+            __m128 selected = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(nibble, lanes), lanes));
+            _mm_storeu_ps(scores + i, _mm_add_ps(_mm_loadu_ps(scores + i), _mm_and_ps(selected, weights)));
+        }
+#else
+        for (int i = 0; i < 64; i++) {
+            scores[i] += ((mask >> i) & 1) ? weight : 0.0f;
+        }
+#endif
+    }
+
+    void condParserScoreBatch(const CondParserRuleset* ruleset, const CondParserBatch* batch, uint64_t* ruleWords, float* scores)
+    {
+        for (int w = 0; w < batch->numWords; w++) {
+            float* wordScores = scores + w * 64;
+            for (int i = 0; i < 64; i++) {
+                wordScores[i] = 0.0f;
+            }
+
+            // rules are taken in index order so the words of shared rules are ready
+            for (int r = 0; r < ruleset->numRules; r++) {
+                const CondParserRuleInfo* info = &ruleset->info[r];
+                if (info->truth == CondParserTruth_Always || info->truth == CondParserTruth_Never) {
+                    ruleWords[r] = info->truth == CondParserTruth_Always ? ~0ull : 0;
+                }
+                else if (info->shared != r) {
+                    ruleWords[r] = ruleWords[info->shared];
+                }
+                else {
+                    const CondParserProgram* program = &ruleset->rules[r];
+                    ruleWords[r] = condParserExecuteWord(program, batch, NULL, w, !program->verified);
+                }
+
+                if (ruleWords[r] != 0) {
+                    condParserAddMasked(wordScores, ruleWords[r], ruleset->weights[r]);
+                }
+            }
+        }
+    }
+
+    // the group a rule over the given slots joins, preferring one that already holds them all, -1 if none fits
+    static int condParserFindTableGroup(const CondParserTableGroups* groups, const int* slots, int numSlots)
+    {
+        int fitting = -1;
+        for (int g = 0; g < groups->numGroups; g++) {
+            const CondParserTableGroup* group = &groups->groups[g];
+            int merged[CONDPARSER_ANALYSIS_SLOTS];
+            int numMerged = condParserSupportUnion(group->slots, group->numSlots, slots, numSlots, merged);
+            if (numMerged == group->numSlots) {
+                return g;
+            }
+            if (fitting < 0 && numMerged >= 0 && numMerged <= CONDPARSER_TABLE_SLOTS) {
+                fitting = g;
+            }
+        }
+        return fitting;
+    }
+
+    int condParserGroupRuleset(const CondParserRuleset* ruleset, CondParserTableGroups* groups)
     {
-        if (ctx->curToken.type == CondParserToken_ID) {
-            bool value = ctx->getValue(ctx->curToken.id);
-            condParserNextToken(ctx);
-            return value;
+        int numRules = ruleset->numRules;
+        for (int w = 0; w < (numRules + 63) >> 6; w++) {
+            groups->grouped[w] = 0;
         }
-        else if (ctx->curToken.type == CondParserToken_LParen) {
-            condParserNextToken(ctx); // consume '('
-            bool value = condParserParseExpr(ctx);
+        groups->numGroups = 0;
 
-            if (ctx->curToken.type != CondParserToken_RParen) {
-                condParserPrintError(ctx, "Error: expected ')', found: ");
-                condParserPrintToken(ctx);
-                condParserPrintError(ctx, "\n");
-                return 0;
+        // first pass: the group of every rule, kept in tables until the rules are sorted by group
+        for (int r = 0; r < numRules; r++) {
+            const CondParserRuleInfo* info = &ruleset->info[r];
+            int slots[CONDPARSER_ANALYSIS_SLOTS];
+            int numSlots = info->shared == r && (info->truth == CondParserTruth_Contingent || info->truth == CondParserTruth_Unknown) ? condParserSupport(&ruleset->rules[r], slots) : -1;
+            if (numSlots <= 0 || numSlots > CONDPARSER_TABLE_SLOTS) {
+                continue;
             }
-            condParserNextToken(ctx); // consume ')'
-            return value;
+
+            uint64_t table;
+            condParserTruthTable(&ruleset->rules[r], slots, numSlots, &table);
+            numSlots = condParserReduceTable(slots, numSlots, &table);
+
+            int g = condParserFindTableGroup(groups, slots, numSlots);
+            if (g < 0 && groups->numGroups == groups->capacity) {
+                continue;
+            }
+            if (g < 0) {
+                g = groups->numGroups++;
+                groups->groups[g].numSlots = 0;
+                groups->groups[g].numRules = 0;
+            }
+
+            CondParserTableGroup* group = &groups->groups[g];
+            int merged[CONDPARSER_ANALYSIS_SLOTS];
+            group->numSlots = condParserSupportUnion(group->slots, group->numSlots, slots, numSlots, merged);
+            for (int j = 0; j < group->numSlots; j++) {
+                group->slots[j] = merged[j];
+            }
+            group->numRules++;
+
+            groups->tables[r] = (uint64_t)g;
+            condParserSetRowBit(groups->grouped, r);
         }
-        else {
-            condParserPrintError(ctx, "Error: expected identifier or '('\n");
-            return 0;
+
+        int numGrouped = 0;
+        for (int g = 0; g < groups->numGroups; g++) {
+            groups->groups[g].firstRule = numGrouped;
+            numGrouped += groups->groups[g].numRules;
+            groups->groups[g].numRules = 0;
+        }
+
+        // second pass: sort the rules by group, tables only gets overwritten once the group ids are read
+        for (int r = 0; r < numRules; r++) {
+            if (condParserTableBit(groups->grouped, r)) {
+                CondParserTableGroup* group = &groups->groups[groups->tables[r]];
+                groups->rules[group->firstRule + group->numRules++] = r;
+            }
+        }
+
+        // the tables over the final slots of each group
+        for (int g = 0; g < groups->numGroups; g++) {
+            const CondParserTableGroup* group = &groups->groups[g];
+            for (int k = group->firstRule; k < group->firstRule + group->numRules; k++) {
+                condParserTruthTable(&ruleset->rules[groups->rules[k]], group->slots, group->numSlots, &groups->tables[k]);
+            }
         }
+
+        return numGrouped;
     }
 
-    static bool condParserParseNot(CondParserContext* ctx)
+    int condParserExecuteGrouped(const CondParserRuleset* ruleset, const CondParserTableGroups* groups, const CondParserEnv* env, uint64_t* results)
     {
-        int notCount = 0;
+        int numWords = (ruleset->numRules + 63) >> 6;
+        for (int w = 0; w < numWords; w++) {
+            results[w] = 0;
+        }
 
-        // count nots
-        while (ctx->curToken.type == CondParserToken_Not)
-        {
-            notCount++;
-            condParserNextToken(ctx);
+        for (int g = 0; g < groups->numGroups; g++) {
+            const CondParserTableGroup* group = &groups->groups[g];
+            unsigned index = 0;
+            for (int j = 0; j < group->numSlots; j++) {
+                index |= (unsigned)((env->bits[group->slots[j] >> 6] >> (group->slots[j] & 63)) & 1) << j;
+            }
+
+            for (int k = group->firstRule; k < group->firstRule + group->numRules; k++) {
+                int r = groups->rules[k];
+                results[r >> 6] |= ((groups->tables[k] >> index) & 1) << (r & 63);
+            }
         }
 
-        bool res = condParserParsePrimary(ctx);
+        // the remaining rules in evaluation order, the grouped results are all in place already
+        int numExecuted = 0;
+        for (int i = 0; i < ruleset->numRules; i++) {
+            int r = ruleset->order ? ruleset->order[i] : i;
+            if (condParserTableBit(groups->grouped, r)) {
+                continue;
+            }
 
-        // negate if odd
-        if (notCount % 2 != 0)
-        {
-            res = !res;
+            int value = condParserSettledValue(ruleset, r, results);
+            if (value < 0) {
+                value = condParserExecute(&ruleset->rules[r], env);
+                numExecuted++;
+            }
+
+            results[r >> 6] |= (uint64_t)value << (r & 63);
         }
 
-        return res;
+        return numExecuted;
     }
 
-    static bool condParserParseAnd(CondParserContext* ctx)
+    void condParserRuleCursorInit(CondParserRuleCursor* cursor, const CondParserRuleset* ruleset, uint64_t* pending)
     {
-        bool value = condParserParseNot(ctx);
-        while (ctx->curToken.type == CondParserToken_And) {
-            condParserNextToken(ctx);
-            bool res = condParserParseNot(ctx);
+        cursor->pending = pending;
+        cursor->numPending = ruleset->numRules;
+        cursor->position = 0;
 
-            value = value && res;
+        for (int w = 0; w < (ruleset->numRules + 63) >> 6; w++) {
+            int remaining = ruleset->numRules - w * 64;
+            pending[w] = remaining < 64 ? (1ull << remaining) - 1 : ~0ull;
         }
-        return value;
     }
 
-    static bool condParserParseOr(CondParserContext* ctx)
+    static bool condParserHasBit(const uint64_t* bits, int numBits, unsigned i)
     {
-        bool value = condParserParseAnd(ctx);
-        while (ctx->curToken.type == CondParserToken_Or) {
-            condParserNextToken(ctx);
+        return bits && i < (unsigned)numBits && ((bits[i >> 6] >> (i & 63)) & 1);
+    }
 
-            bool res = condParserParseAnd(ctx);
-            value = value || res;
+    // whether a program reads any of the given slots or fields
+    static bool condParserReadsAny(const CondParserProgram* program, const uint64_t* slots, int numSlots, const uint64_t* fields, int numFields)
+    {
+        const unsigned char* pc = program->code;
+        const unsigned char* end = pc + program->size;
+        int size;
+        for (; pc < end && (size = condParserInstructionSize(pc, end)) != 0; pc += size) {
+            if (*pc == CondParserOp_Slot && condParserHasBit(slots, numSlots, condParserReadU16(pc + 1))) {
+                return true;
+            }
+            if ((*pc == CondParserOp_In || *pc == CondParserOp_Range) && condParserHasBit(fields, numFields, condParserReadU16(pc + 1))) {
+                return true;
+            }
+            for (unsigned j = 0; *pc == CondParserOp_Table && j < condParserReadU16(pc + 1); j++) {
+                if (condParserHasBit(slots, numSlots, condParserReadU16(pc + 3 + j * 2))) {
+                    return true;
+                }
+            }
+            if (slots && (*pc == CondParserOp_AtLeast || *pc == CondParserOp_AtMost || *pc == CondParserOp_Exactly)) {
+                for (unsigned i = 0; i < condParserReadU16(pc + 5); i++) {
+                    unsigned word = condParserReadU16(pc + 7 + i * 10);
+                    if (word < ((unsigned)numSlots + 63) >> 6) {
+                        uint64_t inRange = (unsigned)numSlots - word * 64 < 64 ? (1ull << ((unsigned)numSlots - word * 64)) - 1 : ~0ull;
+                        if (slots[word] & condParserReadU64(pc + 9 + i * 10) & inRange) {
+                            return true;
+                        }
+                    }
+                }
+            }
         }
+        return false;
+    }
 
-        return value;
+    void condParserRuleCursorInvalidate(CondParserRuleCursor* cursor, const CondParserRuleset* ruleset, const uint64_t* slots, int numSlots, const uint64_t* fields, int numFields)
+    {
+        for (int r = 0; r < ruleset->numRules; r++) {
+            if (condParserHasBit(cursor->pending, ruleset->numRules, (unsigned)r) || !condParserReadsAny(&ruleset->rules[r], slots, numSlots, fields, numFields)) {
+                continue;
+            }
+
+            cursor->pending[r >> 6] |= 1ull << (r & 63);
+            cursor->numPending++;
+
+            // pending rules behind the cursor are picked up before it moves on
+            int position = ruleset->order ? ruleset->info[r].position : r;
+            if (position < cursor->position) {
+                cursor->position = position;
+            }
+        }
     }
 
-    static bool condParserParseExpr(CondParserContext* ctx)
+    int condParserResumeRuleset(const CondParserRuleset* ruleset, CondParserRuleCursor* cursor, const CondParserEnv* env, uint64_t* results, int budget)
     {
-        bool res = condParserParseOr(ctx);
-        return res;
+        for (; cursor->numPending > 0 && cursor->position < ruleset->numRules; cursor->position++) {
+            int r = ruleset->order ? ruleset->order[cursor->position] : cursor->position;
+            if (!condParserHasBit(cursor->pending, ruleset->numRules, (unsigned)r)) {
+                continue;
+            }
+
+            // a rule only reads the results of rules before it in the order, which are up to date
+            int value = condParserSettledValue(ruleset, r, results);
+            if (value < 0) {
+                if (budget == 0) {
+                    break;
+                }
+                value = condParserExecute(&ruleset->rules[r], env);
+                budget--;
+            }
+
+            results[r >> 6] = (results[r >> 6] & ~(1ull << (r & 63))) | ((uint64_t)value << (r & 63));
+            cursor->pending[r >> 6] &= ~(1ull << (r & 63));
+            cursor->numPending--;
+        }
+
+        if (cursor->numPending == 0) {
+            cursor->position = 0;
+        }
+        return cursor->numPending;
     }
 
-    bool condParserEvaluate(const char* expr, PFN_condParserGetValue getValue, PFN_condParserError errorFn)
+    bool condParserCompilePlanned(const char* expr, const CondParserSymbols* symbols, const CondParserStats* stats, PFN_condParserError errorFn, CondParserProgram* program)
     {
+        if (stats == NULL) {
+            return condParserCompile(expr, symbols, errorFn, program);
+        }
+
         CondParserContext ctx;
-        ctx.cur = expr;
-        ctx.error = false;
-        ctx.getValue = getValue;
-        ctx.errorFn = errorFn;
+        condParserInitCompile(&ctx, expr, symbols, errorFn, program);
+        ctx.stats = stats;
 
-        condParserNextToken(&ctx);
+        if (!condParserCompileContext(&ctx)) {
+            return false;
+        }
 
-        return condParserParseExpr(&ctx);
+        // a rule over few slots can run as a single truth table lookup, which reads every slot but dispatches once
+        int slots[CONDPARSER_ANALYSIS_SLOTS];
+        int numSlots = condParserSupport(program, slots);
+        if (numSlots > 0 && numSlots <= CONDPARSER_TABLE_SLOTS && program->capacity >= 11 + 2 * numSlots) {
+            float tableCost = stats->instructionCost;
+            for (int j = 0; j < numSlots; j++) {
+                tableCost += slots[j] < stats->numSlots ? stats->cost[slots[j]] : 1;
+            }
+
+            if (tableCost < ctx.cost) {
+                uint64_t table;
+                condParserTruthTable(program, slots, numSlots, &table);
+
+                program->size = 0;
+                condParserEmit(&ctx, CondParserOp_Table);
+                condParserEmitU16(&ctx, (unsigned)numSlots);
+                for (int j = 0; j < numSlots; j++) {
+                    condParserEmitU16(&ctx, (unsigned)slots[j]);
+                }
+                condParserEmitU64(&ctx, table);
+            }
+        }
+
+        // reordering moved operands to other stack depths, so recompute them
+        return condParserVerify(program, program->numSlots, program->numFields, errorFn);
+    }
+
+    static void condParserSymbolNodeInit(CondParserSymbolNode* node, const char* name, int length)
+    {
+        node->name = name;
+        node->length = length;
+        node->firstChild = -1;
+        node->nextSibling = -1;
+        node->defined = false;
+        node->slot = -1;
+        node->firstSlot = 0;
+        node->numSlots = 0;
+    }
+
+    static int condParserSymbolTableChild(const CondParserSymbolTable* table, int node, const char* name, int length)
+    {
+        for (int child = table->nodes[node].firstChild; child >= 0; child = table->nodes[child].nextSibling) {
+            const CondParserSymbolNode* n = &table->nodes[child];
+            if (n->length == length && CONDPARSER_STRNCMP(n->name, name, length) == 0) {
+                return child;
+            }
+        }
+        return -1;
+    }
+
+    static int condParserSymbolTableFind(const CondParserSymbolTable* table, const char* name)
+    {
+        int node = 0;
+        while (*name != '\0' && node >= 0) {
+            int length = 0;
+            while (name[length] != '\0' && name[length] != '.') length++;
+
+            node = condParserSymbolTableChild(table, node, name, length);
+            name += name[length] == '.' ? length + 1 : length;
+        }
+        return node;
+    }
+
+    static int condParserSymbolTableNumber(CondParserSymbolNode* nodes, int node, int next)
+    {
+        nodes[node].firstSlot = next;
+        if (nodes[node].defined) {
+            nodes[node].slot = next++;
+        }
+
+        for (int child = nodes[node].firstChild; child >= 0; child = nodes[child].nextSibling) {
+            next = condParserSymbolTableNumber(nodes, child, next);
+        }
+
+        nodes[node].numSlots = next - nodes[node].firstSlot;
+        return next;
+    }
+
+    void condParserSymbolTableInit(CondParserSymbolTable* table, CondParserSymbolNode* nodes, int capacity)
+    {
+        table->nodes = nodes;
+        table->capacity = capacity;
+        table->numNodes = 1;
+        table->numSlots = 0;
+
+        // the root is the unnamed namespace holding everything
+        condParserSymbolNodeInit(&nodes[0], "", 0);
+    }
+
+    bool condParserSymbolTableAdd(CondParserSymbolTable* table, const char* name)
+    {
+        // every component must be non-empty, checked before any node is added
+        for (const char* c = name;; c++) {
+            if (*c == '\0' || *c == '.') {
+                if (c == name || c[-1] == '.') {
+                    return false;
+                }
+                if (*c == '\0') {
+                    break;
+                }
+            }
+        }
+
+        int node = 0;
+        for (;;) {
+            int length = 0;
+            while (name[length] != '\0' && name[length] != '.') length++;
+
+            int child = condParserSymbolTableChild(table, node, name, length);
+            if (child < 0) {
+                if (table->numNodes == table->capacity) {
+                    return false;
+                }
+
+                child = table->numNodes++;
+                condParserSymbolNodeInit(&table->nodes[child], name, length);
+
+                // append, so slots follow the order names were added in
+                int* link = &table->nodes[node].firstChild;
+                while (*link >= 0) link = &table->nodes[*link].nextSibling;
+                *link = child;
+            }
+
+            node = child;
+            if (name[length] == '\0') {
+                break;
+            }
+            name += length + 1;
+        }
+
+        table->nodes[node].defined = true;
+        return true;
+    }
+
+    void condParserSymbolTableAssign(CondParserSymbolTable* table)
+    {
+        table->numSlots = condParserSymbolTableNumber(table->nodes, 0, 0);
+    }
+
+    int condParserSymbolTableSlot(const CondParserSymbolTable* table, const char* name)
+    {
+        int node = condParserSymbolTableFind(table, name);
+        return node >= 0 ? table->nodes[node].slot : -1;
+    }
+
+    bool condParserSymbolTableRange(const CondParserSymbolTable* table, const char* prefix, int* firstSlot, int* numSlots)
+    {
+        int node = condParserSymbolTableFind(table, prefix);
+        if (node < 0) {
+            return false;
+        }
+
+        *firstSlot = table->nodes[node].firstSlot;
+        *numSlots = table->nodes[node].numSlots;
+        return true;
+    }
+
+    // atomics for the interner: acquire loads, release stores and compare-and-swap that reloads on failure
+    static uint64_t condParserLoadAcquire64(const uint64_t* p)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#elif defined(_MSC_VER)
+        return (uint64_t)_InterlockedCompareExchange64((volatile __int64*)p, 0, 0);
+#else
+        return *p;
+#endif
+    }
+
+    static void condParserStoreRelease64(uint64_t* p, uint64_t value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __atomic_store_n(p, value, __ATOMIC_RELEASE);
+#elif defined(_MSC_VER)
+        _InterlockedExchange64((volatile __int64*)p, (__int64)value);
+#else
+        *p = value;
+#endif
+    }
+
+    static bool condParserCompareSwap64(uint64_t* p, uint64_t* expected, uint64_t desired)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __atomic_compare_exchange_n(p, expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#elif defined(_MSC_VER)
+        uint64_t previous = (uint64_t)_InterlockedCompareExchange64((volatile __int64*)p, (__int64)desired, (__int64)*expected);
+        bool swapped = previous == *expected;
+        *expected = previous;
+        return swapped;
+#else
+        if (*p != *expected) {
+            *expected = *p;
+            return false;
+        }
+        *p = desired;
+        return true;
+#endif
+    }
+
+    static const char* condParserLoadAcquireName(const char* const* p)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#elif defined(_MSC_VER)
+        return (const char*)_InterlockedCompareExchangePointer((void* volatile*)p, NULL, NULL);
+#else
+        return *p;
+#endif
+    }
+
+    static void condParserStoreReleaseName(const char** p, const char* name)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __atomic_store_n(p, name, __ATOMIC_RELEASE);
+#elif defined(_MSC_VER)
+        _InterlockedExchangePointer((void* volatile*)p, (void*)name);
+#else
+        *p = name;
+#endif
+    }
+
+    // reserves amount units of a counter that must stay within limit, returns the first unit or -1
+    static int condParserReserve(int* counter, int amount, int limit)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        int old = __atomic_load_n(counter, __ATOMIC_RELAXED);
+        do {
+            if (old > limit - amount) {
+                return -1;
+            }
+        } while (!__atomic_compare_exchange_n(counter, &old, old + amount, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        return old;
+#elif defined(_MSC_VER)
+        long old = _InterlockedCompareExchange((volatile long*)counter, 0, 0);
+        for (;;) {
+            if (old > limit - amount) {
+                return -1;
+            }
+            long previous = _InterlockedCompareExchange((volatile long*)counter, old + amount, old);
+            if (previous == old) {
+                return (int)old;
+            }
+            old = previous;
+        }
+#else
+        int old = *counter;
+        if (old > limit - amount) {
+            return -1;
+        }
+        *counter = old + amount;
+        return old;
+#endif
+    }
+
+    // gives back the last reservation of a counter, if nothing was reserved after it
+    static void condParserUnreserve(int* counter, int first, int amount)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        int expected = first + amount;
+        __atomic_compare_exchange_n(counter, &expected, first, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#elif defined(_MSC_VER)
+        _InterlockedCompareExchange((volatile long*)counter, first, first + amount);
+#else
+        if (*counter == first + amount) {
+            *counter = first;
+        }
+#endif
+    }
+
+#define CONDPARSER_INTERN_BUSY 0xffffffffu
+#define CONDPARSER_INTERN_DEAD 0xfffffffeu
+
+    void condParserInternerInit(CondParserInterner* interner, uint64_t* buckets, int capacity, const char** names, int maxSlots, char* chars, int charCapacity)
+    {
+        // probes wrap with capacity - 1 as a mask, other capacities only use their largest power of two
+        while (capacity & (capacity - 1)) {
+            capacity &= capacity - 1;
+        }
+
+        interner->buckets = buckets;
+        interner->capacity = capacity;
+        interner->names = names;
+        interner->maxSlots = maxSlots;
+        interner->chars = chars;
+        interner->charCapacity = charCapacity;
+        interner->numSlots = 0;
+        interner->numChars = 0;
+
+        for (int i = 0; i < capacity; i++) {
+            buckets[i] = 0;
+        }
+        for (int i = 0; i < maxSlots; i++) {
+            names[i] = NULL;
+        }
+    }
+
+    // whether a published bucket holds the name, its slot is in the low half
+    static bool condParserInternerMatch(const CondParserInterner* interner, uint64_t entry, const char* name, int length)
+    {
+        uint32_t low = (uint32_t)entry;
+        if (low == CONDPARSER_INTERN_BUSY || low == CONDPARSER_INTERN_DEAD) {
+            return false;
+        }
+
+        const char* stored = interner->names[low - 1];
+        return CONDPARSER_STRNCMP(stored, name, length) == 0 && stored[length] == '\0';
+    }
+
+    // copies the name and hands out its slot, -1 when the slots or chars run out
+    static int condParserInternerAdd(CondParserInterner* interner, const char* name, int length)
+    {
+        // a failed reservation takes nothing, so the slot goes first: once slots run out inserts use up no chars
+        int slot = condParserReserve(&interner->numSlots, 1, interner->maxSlots);
+        if (slot < 0) {
+            return -1;
+        }
+
+        int offset = condParserReserve(&interner->numChars, length + 1, interner->charCapacity);
+        if (offset < 0) {
+            condParserUnreserve(&interner->numSlots, slot, 1);
+            return -1;
+        }
+
+        char* copy = interner->chars + offset;
+        for (int i = 0; i < length; i++) {
+            copy[i] = name[i];
+        }
+        copy[length] = '\0';
+        // names are read without the bucket by condParserInternerName
+        condParserStoreReleaseName(&interner->names[slot], copy);
+        return slot;
+    }
+
+    // eases the spin of an insert waiting for another thread
+    static void condParserPause(void)
+    {
+#if defined(CONDPARSER_SSE2) || (defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64)))
+        _mm_pause();
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+        __yield();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+        __builtin_ia32_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    // adds the name to a bucket claimed by the caller, the release store publishes the name along with the slot
+    static int condParserInternerFill(CondParserInterner* interner, uint64_t* bucket, uint64_t key, const char* name, int length)
+    {
+        int slot = condParserInternerAdd(interner, name, length);
+        condParserStoreRelease64(bucket, key | (slot < 0 ? CONDPARSER_INTERN_DEAD : (uint32_t)slot + 1));
+        return slot;
+    }
+
+    int condParserIntern(CondParserInterner* interner, const char* name, int length)
+    {
+        uint32_t hash = condParserHash(name, length);
+        uint64_t key = (uint64_t)hash << 32;
+        int mask = interner->capacity - 1;
+
+        int i = (int)(hash & (uint32_t)mask);
+        for (int probe = 0; probe < interner->capacity; probe++, i = (i + 1) & mask) {
+            uint64_t* bucket = &interner->buckets[i];
+            uint64_t entry = condParserLoadAcquire64(bucket);
+
+            if (entry == 0) {
+                if (condParserCompareSwap64(bucket, &entry, key | CONDPARSER_INTERN_BUSY)) {
+                    return condParserInternerFill(interner, bucket, key, name, length);
+                }
+                // lost the bucket, entry now holds the winner
+            }
+
+            if ((uint32_t)(entry >> 32) != hash) {
+                continue;
+            }
+
+            for (;;) {
+                // the same name may be being inserted by another thread
+                while ((uint32_t)entry == CONDPARSER_INTERN_BUSY) {
+                    condParserPause();
+                    entry = condParserLoadAcquire64(bucket);
+                }
+                // a failed insert leaves its bucket to the next name with its hash, which can't be further along
+                if ((uint32_t)entry != CONDPARSER_INTERN_DEAD) {
+                    break;
+                }
+                if (condParserCompareSwap64(bucket, &entry, key | CONDPARSER_INTERN_BUSY)) {
+                    return condParserInternerFill(interner, bucket, key, name, length);
+                }
+            }
+            if (condParserInternerMatch(interner, entry, name, length)) {
+                return (int)(uint32_t)entry - 1;
+            }
+        }
+
+        return -1;
+    }
+
+    int condParserInternerSlot(const CondParserInterner* interner, const char* name, int length)
+    {
+        uint32_t hash = condParserHash(name, length);
+        int mask = interner->capacity - 1;
+
+        // names still being inserted are treated as absent
+        int i = (int)(hash & (uint32_t)mask);
+        for (int probe = 0; probe < interner->capacity; probe++, i = (i + 1) & mask) {
+            uint64_t entry = condParserLoadAcquire64(&interner->buckets[i]);
+            if (entry == 0) {
+                return -1;
+            }
+            if ((uint32_t)(entry >> 32) == hash && condParserInternerMatch(interner, entry, name, length)) {
+                return (int)(uint32_t)entry - 1;
+            }
+        }
+
+        return -1;
+    }
+
+    const char* condParserInternerName(const CondParserInterner* interner, int slot)
+    {
+        return slot >= 0 && slot < interner->maxSlots ? condParserLoadAcquireName(&interner->names[slot]) : NULL;
+    }
+
+    // mask of the bits of word w that fall into [firstSlot, firstSlot + numSlots)
+    static uint64_t condParserRangeMask(int w, int firstSlot, int numSlots)
+    {
+        int lo = firstSlot - w * 64;
+        int hi = firstSlot + numSlots - w * 64;
+        uint64_t mask = ~0ull;
+        if (lo > 0) mask &= ~0ull << lo;
+        if (hi < 64) mask &= ~(~0ull << hi);
+        return mask;
+    }
+
+    void condParserSetRange(uint64_t* bits, int firstSlot, int numSlots, bool value)
+    {
+        if (numSlots <= 0) {
+            return;
+        }
+
+        for (int w = firstSlot >> 6; w <= (firstSlot + numSlots - 1) >> 6; w++) {
+            uint64_t mask = condParserRangeMask(w, firstSlot, numSlots);
+            bits[w] = value ? (bits[w] | mask) : (bits[w] & ~mask);
+        }
+    }
+
+    void condParserCopyRange(uint64_t* dst, const uint64_t* src, int firstSlot, int numSlots)
+    {
+        if (numSlots <= 0) {
+            return;
+        }
+
+        for (int w = firstSlot >> 6; w <= (firstSlot + numSlots - 1) >> 6; w++) {
+            uint64_t mask = condParserRangeMask(w, firstSlot, numSlots);
+            dst[w] = (dst[w] & ~mask) | (src[w] & mask);
+        }
     }
 
 #ifdef __cplusplus
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CONDPARSER_IMPLEMENTATION
+#include "condparser.h"
+
+typedef void (*PFN_benchFunction)(void* userData);
+
+// runs fn until at least half a second has passed and reports the throughput over bytes per run
+static void benchRun(const char* name, size_t bytes, PFN_benchFunction fn, void* userData)
+{
+    int runs = 0;
+    clock_t start = clock();
+    clock_t elapsed;
+    do
+    {
+        fn(userData);
+        runs++;
+        elapsed = clock() - start;
+    } while (elapsed < CLOCKS_PER_SEC / 2);
+
+    double seconds = (double)elapsed / CLOCKS_PER_SEC;
+    printf("%-24s %10.1f MB/s\n", name, (double)bytes * runs / seconds / (1024.0 * 1024.0));
+}
+
+typedef struct
+{
+    const char* expr;
+    CondParserTokenSpan* tokens;
+    int capacity;
+    int numTokens;
+} BenchLexing;
+
+static void benchNextToken(void* userData)
+{
+    BenchLexing* lexing = (BenchLexing*)userData;
+
+    CondParserContext ctx;
+    ctx.cur = lexing->expr;
+    ctx.error = false;
+    ctx.errorFn = NULL;
+    ctx.tokens = NULL;
+
+    int numTokens = 0;
+    do
+    {
+        condParserNextToken(&ctx);
+        numTokens++;
+    } while (ctx.curToken.type != CondParserToken_End);
+    lexing->numTokens = numTokens;
+}
+
+static void benchTokenize(void* userData)
+{
+    BenchLexing* lexing = (BenchLexing*)userData;
+    lexing->numTokens = condParserTokenize(lexing->expr, lexing->tokens, lexing->capacity, NULL);
+}
+
+typedef struct
+{
+    uint64_t* rows;
+    uint64_t* columns;
+    const uint64_t** columnPtrs;
+    const uint64_t** knownPtrs;
+    uint64_t* results;
+    uint64_t* falseResults;
+    CondParserArrowArray* arrays;
+    CondParserProgram program;
+    int numEnvs;
+} BenchBatch;
+
+static int benchGetSlot(const char* id)
+{
+    return id[0] == 's' ? atoi(id + 1) : -1;
+}
+
+static void benchTransposeRows(void* userData)
+{
+    BenchBatch* batch = (BenchBatch*)userData;
+    condParserTransposeRows(batch->rows, 1, batch->numEnvs, batch->columns, 64);
+}
+
+static void benchExecuteBatch(void* userData)
+{
+    BenchBatch* batch = (BenchBatch*)userData;
+    const CondParserBatch columns = { .columns = batch->columnPtrs, .numWords = batch->numEnvs / 64 };
+    condParserExecuteBatch(&batch->program, &columns, batch->results);
+}
+
+static void benchExecuteArrow(void* userData)
+{
+    BenchBatch* batch = (BenchBatch*)userData;
+    const CondParserArrowBatch arrow = { batch->arrays, NULL, batch->numEnvs };
+    condParserExecuteArrow(&batch->program, &arrow, CondParserNulls_False, (uint8_t*)batch->results, NULL);
+}
+
+static void benchExecuteKleene(void* userData)
+{
+    BenchBatch* batch = (BenchBatch*)userData;
+    const CondParserBatch columns = { .columns = batch->columnPtrs, .numWords = batch->numEnvs / 64 };
+    const CondParserKnown known = { .columns = batch->knownPtrs };
+    condParserExecuteKleene(&batch->program, &columns, &known, batch->results, batch->falseResults, NULL);
+}
+
+int main(void)
+{
+    static const char* rule = "(render.shadows.pcf && !net.quic.enabled) || atleast(2, gpu.vendor.nvidia, tier3, platform.windows)   ||\n    ";
+    const int numRules = 8192;
+
+    size_t ruleLength = strlen(rule);
+    size_t length = ruleLength * numRules + 5;
+    char* expr = (char*)malloc(length + 1);
+    for (int i = 0; i < numRules; i++)
+    {
+        memcpy(expr + ruleLength * i, rule, ruleLength);
+    }
+    memcpy(expr + ruleLength * numRules, "false", 6);
+
+    BenchLexing lexing;
+    lexing.expr = expr;
+    lexing.capacity = 32 * numRules;
+    lexing.tokens = (CondParserTokenSpan*)malloc(sizeof(CondParserTokenSpan) * lexing.capacity);
+
+    printf("lexing %d bytes\n", (int)length);
+    benchRun("condParserNextToken", length, benchNextToken, &lexing);
+    benchRun("condParserTokenize", length, benchTokenize, &lexing);
+
+    free(lexing.tokens);
+    free(expr);
+
+    static unsigned char code[256];
+    const CondParserSymbols symbols = { .getSlot = benchGetSlot };
+    BenchBatch batch;
+    batch.numEnvs = 1 << 16;
+    batch.rows = (uint64_t*)malloc(sizeof(uint64_t) * batch.numEnvs);
+    batch.columns = (uint64_t*)malloc(sizeof(uint64_t) * batch.numEnvs);
+    batch.columnPtrs = (const uint64_t**)malloc(sizeof(uint64_t*) * 64);
+    batch.knownPtrs = (const uint64_t**)malloc(sizeof(uint64_t*) * 64);
+    batch.results = (uint64_t*)malloc(sizeof(uint64_t) * batch.numEnvs / 64);
+    batch.falseResults = (uint64_t*)malloc(sizeof(uint64_t) * batch.numEnvs / 64);
+    batch.arrays = (CondParserArrowArray*)malloc(sizeof(CondParserArrowArray) * 64);
+    batch.program.code = code;
+    batch.program.capacity = sizeof(code);
+    condParserCompile("(s1 && !s7) || atleast(2, s12, s30, s63) || (s40 && s41 && !s42)", &symbols, NULL, &batch.program);
+
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < batch.numEnvs; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        batch.rows[i] = state;
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        batch.columnPtrs[i] = batch.columns + i * (batch.numEnvs / 64);
+        batch.arrays[i].values = batch.columnPtrs[i];
+        batch.arrays[i].validity = NULL;
+        batch.arrays[i].offset = 0;
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        // about half of the values are missing
+        batch.knownPtrs[i] = batch.columnPtrs[(i + 1) & 63];
+    }
+
+    printf("batch of %d environments with 64 slots\n", batch.numEnvs);
+    benchRun("condParserTransposeRows", sizeof(uint64_t) * batch.numEnvs, benchTransposeRows, &batch);
+    benchRun("condParserExecuteBatch", sizeof(uint64_t) * batch.numEnvs, benchExecuteBatch, &batch);
+    benchRun("condParserExecuteArrow", sizeof(uint64_t) * batch.numEnvs, benchExecuteArrow, &batch);
+    benchRun("condParserExecuteKleene", sizeof(uint64_t) * batch.numEnvs, benchExecuteKleene, &batch);
+
+    free(batch.arrays);
+    free(batch.falseResults);
+    free(batch.results);
+    free(batch.knownPtrs);
+    free(batch.columnPtrs);
+    free(batch.columns);
+    free(batch.rows);
+    return 0;
+}
@@ -60,4 +60,1702 @@ UTEST(condparser, simple) {
         bool res = condParserEvaluate(tests[i].expr, condParserTestGetValue, condParserTestError);
         ASSERT_TRUE_MSG(res == tests[i].expected, tests[i].expr);
     }
-}
\ No newline at end of file
+}
+UTEST(condparser, threshold) {
+    const CondParserTest tests[] = {
+        { "atleast(2, true, false, true)", true },
+        { "atleast(3, true, false, true)", false },
+        { "atmost(1, true, false, false)", true },
+        { "atmost(1, true, false, true)", false },
+        { "exactly(2, true, true, false, false)", true },
+        { "exactly(2, true, true, true, false)", false },
+        { "atleast(0, false)", true },
+        { "atleast(1, false || true, true && false)", true },
+        { "!atleast(2, true, false) && exactly(1, (true), !true)", true }
+    };
+
+    const int numTests = sizeof(tests) / sizeof(tests[0]);
+
+    for (int i = 0; i < numTests; i++)
+    {
+        bool res = condParserEvaluate(tests[i].expr, condParserTestGetValue, condParserTestError);
+        ASSERT_TRUE_MSG(res == tests[i].expected, tests[i].expr);
+    }
+}
+
+// identifiers a..f map to slots 0..5 and to the bits of the current assignment
+static unsigned condParserTestAssignment;
+
+bool condParserTestGetAssigned(const char* id)
+{
+    return (condParserTestAssignment >> (id[0] - 'a')) & 1;
+}
+
+int condParserTestGetSlot(const char* id)
+{
+    return (id[0] >= 'a' && id[0] <= 'f' && id[1] == '\0') ? id[0] - 'a' : -1;
+}
+
+static const char* condParserTestPrograms[] = {
+    "a",
+    "!a && b",
+    "a || b && c",
+    "!(a || b) && (c || !d)",
+    "(a && b) || (c && d) || (e && f)",
+    "atleast(3, a, b, c, d, e, f)",
+    "atmost(2, a, b, c, d, e, f)",
+    "exactly(2, a, !b, c && d, e || f)",
+    "atleast(2, a, a, b)",
+    "!exactly(1, a, b) || atleast(1, c, atmost(0, d, e))",
+    "a && true || false && b",
+    "!(false || 0) && (1 && b)",
+    "atleast(2, true, a, b, false)",
+    "atmost(1, true, true, a)",
+    "exactly(1, true, a && c)",
+    "(a || !true) && (c || !false)",
+    "a ^ b ^ c",
+    "a == b && c != d",
+    "a -> b -> c",
+    "a ? b : c",
+    "a ? b ? c : d : e ? f : !a",
+    "!a == b ^ c || d -> e ? f : a && b",
+    "(a -> b) == (!a || b) ^ e",
+    "atleast(2, a ? b : c, d -> e, f ^ a)",
+    "a ^ true || false -> b",
+    "a == true && b != false",
+    "a ? true : b",
+    "a ? false : b",
+    "a ? b : true",
+    "a ? b : false",
+    "a ? true : false",
+    "a ? false : true",
+    "a ? c : c",
+    "false ? a : b ^ c",
+    "true ? a : b"
+};
+
+UTEST(condparser, compiled) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+
+    // all 64 assignments of a..f form one bit-sliced word
+    uint64_t columns[6];
+    const uint64_t* columnPtrs[6];
+    for (int v = 0; v < 6; v++)
+    {
+        columns[v] = 0;
+        for (int i = 0; i < 64; i++)
+        {
+            columns[v] |= (uint64_t)((i >> v) & 1) << i;
+        }
+        columnPtrs[v] = &columns[v];
+    }
+    const CondParserBatch batch = { .columns = columnPtrs, .numWords = 1 };
+
+    const int numPrograms = sizeof(condParserTestPrograms) / sizeof(condParserTestPrograms[0]);
+
+    for (int i = 0; i < numPrograms; i++)
+    {
+        const char* expr = condParserTestPrograms[i];
+
+        unsigned char code[256];
+        CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+        ASSERT_TRUE_MSG(condParserCompile(expr, &symbols, condParserTestError, &program), expr);
+
+        uint64_t batchResult;
+        condParserExecuteBatch(&program, &batch, &batchResult);
+
+        for (unsigned a = 0; a < 64; a++)
+        {
+            condParserTestAssignment = a;
+            bool expected = condParserEvaluate(expr, condParserTestGetAssigned, condParserTestError);
+
+            const uint64_t bits = a;
+            const CondParserEnv env = { .bits = &bits };
+            ASSERT_TRUE_MSG(condParserExecute(&program, &env) == expected, expr);
+            ASSERT_TRUE_MSG(((batchResult >> a) & 1) == expected, expr);
+        }
+    }
+}
+
+UTEST(condparser, compileErrors) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+
+    unsigned char code[256];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+    ASSERT_FALSE(condParserCompile("a && unknown", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("a && (b", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("a b", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("atleast(a, b)", &symbols, NULL, &program));
+
+    unsigned char small[4];
+    CondParserProgram smallProgram = { .code = small, .capacity = sizeof(small) };
+    ASSERT_FALSE(condParserCompile("a && b", &symbols, NULL, &smallProgram));
+}
+
+// enumerated identifier "gpu" with the values nvidia, amd and intel
+static const char* condParserTestGpuNames[] = { "nvidia", "amd", "intel" };
+static int condParserTestGpu;
+
+const char* condParserTestGetEnum(const char* id)
+{
+    return strcmp(id, "gpu") == 0 ? condParserTestGpuNames[condParserTestGpu] : NULL;
+}
+
+int condParserTestGetField(const char* id)
+{
+    return strcmp(id, "gpu") == 0 ? 0 : -1;
+}
+
+int condParserTestGetEnumerator(const char* id, const char* name)
+{
+    for (int i = 0; i < 3 && strcmp(id, "gpu") == 0; i++)
+    {
+        if (strcmp(name, condParserTestGpuNames[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+UTEST(condparser, membership) {
+    const CondParserCallbacks callbacks = { .getValue = condParserTestGetAssigned, .getEnum = condParserTestGetEnum, .errorFn = condParserTestError };
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot, .getField = condParserTestGetField, .getEnumerator = condParserTestGetEnumerator };
+
+    const char* exprs[] = {
+        "gpu in (nvidia, amd)",
+        "gpu in (intel) && a",
+        "!(gpu in (amd)) || b",
+        "atleast(2, gpu in (nvidia), a, b)"
+    };
+
+    const int numExprs = sizeof(exprs) / sizeof(exprs[0]);
+
+    for (int i = 0; i < numExprs; i++)
+    {
+        unsigned char code[256];
+        CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+        ASSERT_TRUE_MSG(condParserCompile(exprs[i], &symbols, condParserTestError, &program), exprs[i]);
+        ASSERT_EQ(program.numFields, 1);
+
+        for (condParserTestGpu = 0; condParserTestGpu < 3; condParserTestGpu++)
+        {
+            // the same gpu in all 64 environments of the batch
+            int32_t gpuColumn[64];
+            for (int e = 0; e < 64; e++)
+            {
+                gpuColumn[e] = condParserTestGpu;
+            }
+            const int32_t* fieldPtrs[1] = { gpuColumn };
+
+            uint64_t columns[6];
+            const uint64_t* columnPtrs[6];
+            for (int v = 0; v < 6; v++)
+            {
+                columns[v] = 0;
+                for (int e = 0; e < 64; e++)
+                {
+                    columns[v] |= (uint64_t)((e >> v) & 1) << e;
+                }
+                columnPtrs[v] = &columns[v];
+            }
+            const CondParserBatch batch = { columnPtrs, 1, fieldPtrs };
+
+            uint64_t batchResult;
+            condParserExecuteBatch(&program, &batch, &batchResult);
+
+            for (unsigned a = 0; a < 64; a++)
+            {
+                condParserTestAssignment = a;
+                bool expected = condParserEvaluateEx(exprs[i], &callbacks);
+
+                const uint64_t bits = a;
+                const int32_t fields = condParserTestGpu;
+                const CondParserEnv env = { &bits, &fields };
+                ASSERT_TRUE_MSG(condParserExecute(&program, &env) == expected, exprs[i]);
+                ASSERT_TRUE_MSG(((batchResult >> a) & 1) == expected, exprs[i]);
+            }
+        }
+    }
+
+    condParserTestGpu = 2;
+    ASSERT_FALSE(condParserEvaluateEx("gpu in (nvidia, amd)", &callbacks));
+    ASSERT_TRUE(condParserEvaluateEx("gpu in (nvidia, intel)", &callbacks));
+
+    unsigned char code[256];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+    ASSERT_FALSE(condParserCompile("gpu in (nvidia, voodoo)", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("a in (nvidia)", &symbols, NULL, &program));
+}
+
+bool condParserTestGetDotted(const char* id)
+{
+    return strcmp(id, "render.shadows.pcf") == 0;
+}
+
+static char condParserTestMessages[512];
+
+void condParserTestCaptureError(const char* msg)
+{
+    strncat(condParserTestMessages, msg, sizeof(condParserTestMessages) - strlen(condParserTestMessages) - 1);
+}
+
+UTEST(condparser, symbolTable) {
+    CondParserSymbolNode nodes[16];
+    CondParserSymbolTable table;
+    condParserSymbolTableInit(&table, nodes, 16);
+
+    ASSERT_TRUE(condParserSymbolTableAdd(&table, "render.shadows.pcf"));
+    ASSERT_TRUE(condParserSymbolTableAdd(&table, "net.quic.enabled"));
+    ASSERT_TRUE(condParserSymbolTableAdd(&table, "render.bloom"));
+    ASSERT_TRUE(condParserSymbolTableAdd(&table, "net.tcp"));
+    ASSERT_TRUE(condParserSymbolTableAdd(&table, "render.shadows.vsm"));
+    ASSERT_TRUE(condParserSymbolTableAdd(&table, "vsync"));
+    ASSERT_FALSE(condParserSymbolTableAdd(&table, "net..udp"));
+    ASSERT_FALSE(condParserSymbolTableAdd(&table, "audio."));
+    ASSERT_FALSE(condParserSymbolTableAdd(&table, ".audio"));
+    ASSERT_FALSE(condParserSymbolTableAdd(&table, ""));
+    condParserSymbolTableAssign(&table);
+    ASSERT_EQ(table.numSlots, 6);
+    ASSERT_EQ(table.numNodes, 11);
+
+    // namespaces get contiguous ranges
+    int first, count;
+    ASSERT_TRUE(condParserSymbolTableRange(&table, "render", &first, &count));
+    ASSERT_EQ(first, 0);
+    ASSERT_EQ(count, 3);
+    ASSERT_TRUE(condParserSymbolTableRange(&table, "render.shadows", &first, &count));
+    ASSERT_EQ(count, 2);
+    ASSERT_EQ(condParserSymbolTableSlot(&table, "render.shadows.pcf"), first);
+    ASSERT_EQ(condParserSymbolTableSlot(&table, "render.shadows.vsm"), first + 1);
+    ASSERT_EQ(condParserSymbolTableSlot(&table, "render.shadows"), -1);
+    ASSERT_EQ(condParserSymbolTableSlot(&table, "render.shadow"), -1);
+    ASSERT_FALSE(condParserSymbolTableRange(&table, "audio", &first, &count));
+
+    // namespace defaults and overrides
+    uint64_t bits = 0;
+    ASSERT_TRUE(condParserSymbolTableRange(&table, "net", &first, &count));
+    condParserSetRange(&bits, first, count, true);
+    ASSERT_EQ(bits, ((1ull << count) - 1) << first);
+
+    uint64_t overrides = ~0ull;
+    ASSERT_TRUE(condParserSymbolTableRange(&table, "render.shadows", &first, &count));
+    condParserCopyRange(&bits, &overrides, first, count);
+    condParserSetRange(&bits, condParserSymbolTableSlot(&table, "net.tcp"), 1, false);
+
+    const CondParserSymbols symbols = { .table = &table };
+    unsigned char code[64];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+    ASSERT_TRUE(condParserCompile("render.shadows.pcf && net.quic.enabled && !net.tcp && !render.bloom", &symbols, condParserTestError, &program));
+    const CondParserEnv env = { .bits = &bits };
+    ASSERT_TRUE(condParserExecute(&program, &env));
+    ASSERT_FALSE(condParserCompile("render.shadows", &symbols, NULL, &program));
+
+    // the interpreter passes dotted identifiers through as written
+    ASSERT_TRUE(condParserEvaluate("render.shadows.pcf && !render.shadows", condParserTestGetDotted, condParserTestError));
+
+    // long dotted names are reported whole, on both lexing paths
+    const char* longName = "render.shadows.cascades.distance.far";
+    condParserTestMessages[0] = '\0';
+    ASSERT_FALSE(condParserEvaluate(longName, condParserTestGetDotted, condParserTestCaptureError));
+    ASSERT_TRUE(strstr(condParserTestMessages, "identifier too long") != NULL);
+    ASSERT_TRUE(strstr(condParserTestMessages, "Unknown character") == NULL);
+    ASSERT_FALSE(condParserCompile(longName, &symbols, NULL, &program));
+    CondParserTokenSpan spans[8];
+    ASSERT_EQ(condParserTokenize(longName, spans, 8, NULL), 2);
+    ASSERT_FALSE(condParserCompileTokens(longName, spans, &symbols, NULL, &program));
+
+    // ranges spanning words
+    uint64_t wide[3] = { 0, 0, 0 };
+    condParserSetRange(wide, 60, 70, true);
+    ASSERT_EQ(wide[0], 0xfull << 60);
+    ASSERT_EQ(wide[1], ~0ull);
+    ASSERT_EQ(wide[2], 0x3ull);
+}
+
+static int condParserTestCalls;
+
+bool condParserTestCountingGetValue(const char* id)
+{
+    condParserTestCalls++;
+    return condParserTestGetValue(id);
+}
+
+UTEST(condparser, constants) {
+    condParserTestCalls = 0;
+    ASSERT_TRUE(condParserEvaluate("true && !false && 1 && !0", condParserTestCountingGetValue, condParserTestError));
+    ASSERT_EQ(condParserTestCalls, 0);
+
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+    unsigned char code[64];
+    unsigned char folded[64];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+    CondParserProgram foldedProgram = { .code = folded, .capacity = sizeof(folded) };
+
+    // neutral constants disappear
+    ASSERT_TRUE(condParserCompile("a", &symbols, condParserTestError, &program));
+    ASSERT_TRUE(condParserCompile("(true && a) || false", &symbols, condParserTestError, &foldedProgram));
+    ASSERT_EQ(foldedProgram.size, program.size);
+    ASSERT_EQ(memcmp(code, folded, program.size), 0);
+
+    // absorbing constants drop the whole chain
+    ASSERT_TRUE(condParserCompile("a && b || true", &symbols, condParserTestError, &foldedProgram));
+    ASSERT_EQ(foldedProgram.size, 1);
+    ASSERT_EQ(foldedProgram.maxStack, 1);
+    ASSERT_TRUE(condParserCompile("false && (a || b)", &symbols, condParserTestError, &foldedProgram));
+    ASSERT_EQ(foldedProgram.size, 1);
+
+    const uint64_t bits = 0;
+    const CondParserEnv env = { .bits = &bits };
+    ASSERT_TRUE(condParserCompile("atleast(1, false, b, true)", &symbols, condParserTestError, &foldedProgram));
+    ASSERT_TRUE(condParserExecute(&foldedProgram, &env));
+    ASSERT_TRUE(condParserCompile("!(a || !false)", &symbols, condParserTestError, &foldedProgram));
+    ASSERT_FALSE(condParserExecute(&foldedProgram, &env));
+
+    // counts the operands can't reach, or can't exceed, are decided at compile time
+    const struct
+    {
+        const char* expr;
+        bool value;
+    } thresholds[] = {
+        { "atleast(3, a, b)", false },
+        { "exactly(3, a, b || c)", false },
+        { "atleast(3, a, true, false)", false },
+        { "atmost(5, a, b)", true },
+        { "atmost(2, a, !b)", true },
+        { "atmost(3, a, a, true)", true }
+    };
+    for (int i = 0; i < (int)(sizeof(thresholds) / sizeof(thresholds[0])); i++)
+    {
+        ASSERT_TRUE_MSG(condParserCompile(thresholds[i].expr, &symbols, condParserTestError, &foldedProgram), thresholds[i].expr);
+        ASSERT_EQ_MSG(foldedProgram.size, 1, thresholds[i].expr);
+        ASSERT_EQ_MSG(condParserExecute(&foldedProgram, &env), thresholds[i].value, thresholds[i].expr);
+    }
+    ASSERT_TRUE(condParserCompile("atmost(2, a, b, c)", &symbols, condParserTestError, &foldedProgram));
+    ASSERT_TRUE(foldedProgram.size > 1);
+
+    // dead operands are still checked
+    ASSERT_FALSE(condParserCompile("false && unknown", &symbols, NULL, &foldedProgram));
+    ASSERT_FALSE(condParserCompile("a && 2", &symbols, NULL, &foldedProgram));
+}
+
+UTEST(condparser, verify) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+    const int numPrograms = sizeof(condParserTestPrograms) / sizeof(condParserTestPrograms[0]);
+
+    // compiled programs verify, and run the same on the checked and unchecked paths
+    for (int i = 0; i < numPrograms; i++)
+    {
+        const char* expr = condParserTestPrograms[i];
+
+        unsigned char code[256];
+        CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+        ASSERT_TRUE_MSG(condParserCompile(expr, &symbols, condParserTestError, &program), expr);
+        ASSERT_TRUE(program.verified);
+
+        CondParserProgram loaded = { .code = code, .capacity = sizeof(code), .size = program.size };
+        if (program.numSlots > 2)
+        {
+            ASSERT_FALSE(condParserVerify(&loaded, 2, 0, NULL));
+        }
+        ASSERT_TRUE_MSG(condParserVerify(&loaded, 6, 0, condParserTestError), expr);
+        ASSERT_EQ(loaded.maxStack, program.maxStack);
+
+        CondParserProgram unverified = loaded;
+        unverified.verified = false;
+        for (uint64_t bits = 0; bits < 64; bits++)
+        {
+            const CondParserEnv env = { .bits = &bits };
+            ASSERT_EQ(condParserExecute(&loaded, &env), condParserExecute(&unverified, &env));
+        }
+    }
+
+    const struct
+    {
+        unsigned char code[20];
+        int size;
+    } malformed[] = {
+        { { 0xff }, 1 },                                                    // invalid opcode
+        { { CondParserOp_Slot, 0 }, 2 },                                    // truncated operand
+        { { CondParserOp_Slot, 9, 0 }, 3 },                                 // slot out of range
+        { { CondParserOp_And }, 1 },                                        // stack underflow
+        { { CondParserOp_True, CondParserOp_True }, 2 },                    // two results
+        { { CondParserOp_True, CondParserOp_JumpIfTrue, 5, 0 }, 4 },        // jump past the end
+        { { CondParserOp_Slot, 0, 0, CondParserOp_JumpIfFalse, 1, 0, CondParserOp_Slot, 1, 0, CondParserOp_And }, 10 }, // jump into an instruction
+        { { CondParserOp_In, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 11 },         // field out of range
+        { { CondParserOp_AtLeast, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, 17 } // empty mask
+    };
+
+    const int numMalformed = sizeof(malformed) / sizeof(malformed[0]);
+
+    for (int i = 0; i < numMalformed; i++)
+    {
+        unsigned char code[20];
+        memcpy(code, malformed[i].code, sizeof(code));
+        CondParserProgram program = { .code = code, .capacity = sizeof(code), .size = malformed[i].size };
+        ASSERT_FALSE(condParserVerify(&program, 6, 0, NULL));
+        ASSERT_FALSE(program.verified);
+
+        const uint64_t bits = ~0ull;
+        const CondParserEnv env = { .bits = &bits };
+        ASSERT_FALSE(condParserExecute(&program, &env));
+    }
+
+    // mutated programs are either rejected or safe to run unchecked
+    unsigned char original[256];
+    CondParserProgram source = { .code = original, .capacity = sizeof(original) };
+    ASSERT_TRUE(condParserCompile("atleast(2, a, b && !c, d || e, f) && (a || !b)", &symbols, condParserTestError, &source));
+
+    uint32_t seed = 12345;
+    for (int round = 0; round < 2000; round++)
+    {
+        unsigned char code[256];
+        memcpy(code, original, source.size);
+        seed = seed * 1664525u + 1013904223u;
+        code[(seed >> 8) % source.size] = (unsigned char)(seed >> 24);
+
+        CondParserProgram program = { .code = code, .capacity = sizeof(code), .size = source.size, .numSlots = 6 };
+        const uint64_t bits = seed;
+        const CondParserEnv env = { .bits = &bits };
+        bool checked = condParserExecute(&program, &env);
+        if (condParserVerify(&program, 6, 0, NULL))
+        {
+            ASSERT_EQ(condParserExecute(&program, &env), checked);
+        }
+    }
+}
+
+UTEST(condparser, shortCircuit) {
+    const struct
+    {
+        const char* expr;
+        bool expected;
+        int calls;
+    } tests[] = {
+        { "false && (a || b || !(c && d))", false, 0 },
+        { "true || a && (b || c)", true, 0 },
+        { "false && a || true", true, 0 },
+        { "(false && a && b) || false", false, 0 },
+        { "false || (true || x) && false", false, 0 },
+        { "atleast(1, true, a, (b || c), d)", true, 0 },
+        { "atmost(0, true, a, b)", false, 0 },
+        { "exactly(1, true, a, b)", true, 2 },
+        { "atleast(1, false || true, atleast(2, a, b, c)) && q", false, 1 },
+        { "true && x", false, 1 }
+    };
+
+    const int numTests = sizeof(tests) / sizeof(tests[0]);
+
+    for (int i = 0; i < numTests; i++)
+    {
+        condParserTestCalls = 0;
+        bool res = condParserEvaluate(tests[i].expr, condParserTestCountingGetValue, NULL);
+        ASSERT_TRUE_MSG(res == tests[i].expected, tests[i].expr);
+        ASSERT_EQ_MSG(condParserTestCalls, tests[i].calls, tests[i].expr);
+    }
+
+    // long dead operands at every alignment
+    char expr[512];
+    for (int offset = 0; offset < 32; offset++)
+    {
+        int n = 0;
+        for (int i = 0; i < offset; i++) expr[n++] = ' ';
+        n += sprintf(expr + n, "(false && (a || (b && c) || dddddddddddddddddddd || eeeeeeeeeeeeeeeeeeee || f)) || (true && !false)");
+
+        condParserTestCalls = 0;
+        ASSERT_TRUE(condParserEvaluate(expr, condParserTestCountingGetValue, condParserTestError));
+        ASSERT_EQ(condParserTestCalls, 0);
+    }
+}
+
+UTEST(condparser, tokenize) {
+    const char* expr = "  atleast(2, render.shadows.pcf,!b) || (a && 17)";
+    const CondParserTokenType types[] = {
+        CondParserToken_AtLeast, CondParserToken_LParen, CondParserToken_Number, CondParserToken_Comma, CondParserToken_ID,
+        CondParserToken_Comma, CondParserToken_Not, CondParserToken_ID, CondParserToken_RParen, CondParserToken_Or,
+        CondParserToken_LParen, CondParserToken_ID, CondParserToken_And, CondParserToken_Number, CondParserToken_RParen,
+        CondParserToken_End
+    };
+    const int numTypes = sizeof(types) / sizeof(types[0]);
+
+    CondParserTokenSpan tokens[32];
+    ASSERT_EQ(condParserTokenize(expr, tokens, 32, condParserTestError), numTypes);
+    for (int i = 0; i < numTypes; i++)
+    {
+        ASSERT_EQ(tokens[i].type, types[i]);
+    }
+    ASSERT_EQ(tokens[0].offset, 2);
+    ASSERT_EQ(tokens[0].length, 7);
+    ASSERT_EQ(tokens[4].length, 18);
+    ASSERT_EQ(tokens[4].hash, condParserHash("render.shadows.pcf", 18));
+    ASSERT_EQ(tokens[13].number, 17);
+
+    // compiling the spans gives the same program as compiling the text
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+    const int numPrograms = sizeof(condParserTestPrograms) / sizeof(condParserTestPrograms[0]);
+
+    for (int i = 0; i < numPrograms; i++)
+    {
+        unsigned char code[256];
+        unsigned char fromTokens[256];
+        CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+        CondParserProgram tokenProgram = { .code = fromTokens, .capacity = sizeof(fromTokens) };
+
+        ASSERT_TRUE(condParserTokenize(condParserTestPrograms[i], tokens, 32, condParserTestError) > 0);
+        ASSERT_TRUE(condParserCompile(condParserTestPrograms[i], &symbols, condParserTestError, &program));
+        ASSERT_TRUE(condParserCompileTokens(condParserTestPrograms[i], tokens, &symbols, condParserTestError, &tokenProgram));
+        ASSERT_EQ(tokenProgram.size, program.size);
+        ASSERT_EQ(memcmp(code, fromTokens, program.size), 0);
+    }
+
+    // runs crossing 16-byte blocks at every alignment, including a dot that ends an identifier
+    char text[128];
+    for (int offset = 0; offset < 32; offset++)
+    {
+        int n = 0;
+        for (int i = 0; i < offset; i++) text[n++] = ' ';
+        sprintf(text + n, "abcdefghijklmno.pqrstu  \t  12345678 zz.");
+
+        ASSERT_EQ(condParserTokenize(text, tokens, 32, NULL), -1);
+        ASSERT_EQ(condParserTokenize(text + offset, tokens, 32, NULL), -1);
+        text[n + 38] = '\0';
+        ASSERT_EQ(condParserTokenize(text, tokens, 32, condParserTestError), 4);
+        ASSERT_EQ(tokens[0].offset, offset);
+        ASSERT_EQ(tokens[0].length, 22);
+        ASSERT_EQ(tokens[1].number, 12345678);
+        ASSERT_EQ(tokens[2].length, 2);
+    }
+
+    ASSERT_EQ(condParserTokenize("a && $", tokens, 32, NULL), -1);
+    ASSERT_EQ(condParserTokenize("a && b", tokens, 2, NULL), -1);
+}
+
+UTEST(condparser, ruleset) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot, .getField = condParserTestGetField, .getEnumerator = condParserTestGetEnumerator };
+
+    const struct
+    {
+        const char* expr;
+        CondParserTruth truth;
+        int shared;
+    } rules[] = {
+        { "a && b", CondParserTruth_Contingent, 0 },
+        { "a || !a", CondParserTruth_Always, 1 },
+        { "b && a", CondParserTruth_Contingent, 0 },
+        { "c && !c && d", CondParserTruth_Never, 3 },
+        { "!(!a || !b) || (c && !c)", CondParserTruth_Contingent, 0 },
+        { "atleast(2, a, b)", CondParserTruth_Contingent, 0 },
+        { "atleast(2, a, b, c)", CondParserTruth_Contingent, 6 },
+        { "a && b || a && c || b && c", CondParserTruth_Contingent, 6 },
+        { "exactly(1, a, !a) && (d || !d)", CondParserTruth_Always, 8 },
+        { "gpu in (amd) && a", CondParserTruth_Unknown, 9 },
+        { "gpu in (amd) && a", CondParserTruth_Unknown, 9 },
+        { "a && gpu in (amd)", CondParserTruth_Unknown, 11 }
+    };
+    const int numRules = sizeof(rules) / sizeof(rules[0]);
+
+    unsigned char code[12][128];
+    CondParserProgram programs[12];
+    CondParserRuleInfo info[12];
+    for (int r = 0; r < numRules; r++)
+    {
+        CondParserProgram program = { .code = code[r], .capacity = sizeof(code[r]) };
+        ASSERT_TRUE_MSG(condParserCompile(rules[r].expr, &symbols, condParserTestError, &program), rules[r].expr);
+        programs[r] = program;
+    }
+
+    CondParserRuleset ruleset = { .rules = programs, .info = info, .numRules = numRules };
+    ASSERT_EQ(condParserAnalyzeRuleset(&ruleset, 100000), 4);
+    for (int r = 0; r < numRules; r++)
+    {
+        ASSERT_EQ_MSG((int)info[r].truth, (int)rules[r].truth, rules[r].expr);
+        ASSERT_EQ_MSG(info[r].shared, rules[r].shared, rules[r].expr);
+    }
+
+    // shared and constant rules give the same results as evaluating every rule
+    for (uint64_t bits = 0; bits < 64; bits++)
+    {
+        const int32_t fields = (int32_t)(bits % 3);
+        const CondParserEnv env = { &bits, &fields };
+        uint64_t results;
+        condParserExecuteRuleset(&ruleset, &env, &results);
+        for (int r = 0; r < numRules; r++)
+        {
+            ASSERT_EQ_MSG((bool)((results >> r) & 1), condParserExecute(&programs[r], &env), rules[r].expr);
+        }
+    }
+
+    // without a budget only identical programs are merged
+    ASSERT_EQ(condParserAnalyzeRuleset(&ruleset, 0), 11);
+    ASSERT_EQ((int)info[1].truth, (int)CondParserTruth_Unknown);
+    ASSERT_EQ(info[10].shared, 9);
+}
+
+UTEST(condparser, implications) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+
+    const char* rules[] = {
+        "a && b && c",
+        "a",
+        "a && b",
+        "a || d",
+        "e && !f",
+        "a && b || true",
+        "b && a"
+    };
+    const int numRules = sizeof(rules) / sizeof(rules[0]);
+
+    unsigned char code[7][64];
+    CondParserProgram programs[7];
+    CondParserRuleInfo info[7];
+    for (int r = 0; r < numRules; r++)
+    {
+        CondParserProgram program = { .code = code[r], .capacity = sizeof(code[r]) };
+        ASSERT_TRUE_MSG(condParserCompile(rules[r], &symbols, condParserTestError, &program), rules[r]);
+        programs[r] = program;
+    }
+
+    int order[7];
+    uint64_t settleTrue[7];
+    uint64_t settleFalse[7];
+    CondParserRuleset ruleset = { .rules = programs, .info = info, .numRules = numRules, .order = order, .settleTrue = settleTrue, .settleFalse = settleFalse };
+    ASSERT_EQ(condParserAnalyzeRuleset(&ruleset, 100000), 5);
+
+    // the first four rules each relate to three others and keep their order, the constant and the duplicate go last
+    ASSERT_EQ(order[0], 0);
+    ASSERT_EQ(order[3], 3);
+    ASSERT_EQ(order[5], 5);
+    ASSERT_EQ(order[6], 6);
+    for (int i = 0; i < numRules; i++)
+    {
+        ASSERT_EQ(info[order[i]].position, i);
+    }
+
+    // a is true when a && b && c is, a && b is false when a is
+    ASSERT_TRUE(settleTrue[1] & 1);
+    ASSERT_TRUE((settleFalse[2] >> 1) & 1);
+    ASSERT_FALSE(settleFalse[0]);
+    ASSERT_FALSE(settleTrue[4] | settleFalse[4]);
+
+    int totalExecuted = 0;
+    for (uint64_t bits = 0; bits < 64; bits++)
+    {
+        const CondParserEnv env = { .bits = &bits };
+        uint64_t results;
+        totalExecuted += condParserExecuteRuleset(&ruleset, &env, &results);
+        for (int r = 0; r < numRules; r++)
+        {
+            ASSERT_EQ_MSG((bool)((results >> r) & 1), condParserExecute(&programs[r], &env), rules[r]);
+        }
+    }
+
+    // without the implications all five remaining rules run for every environment
+    ASSERT_LT(totalExecuted, 5 * 64);
+}
+
+UTEST(condparser, planned) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+    const float probability[6] = { 0.9f, 0.1f, 0.5f, 0.99f, 0.3f, 0.7f };
+    const float cost[6] = { 1.0f, 1.0f, 4.0f, 0.5f, 2.0f, 8.0f };
+
+    uint64_t columns[6];
+    const uint64_t* columnPtrs[6];
+    for (int v = 0; v < 6; v++)
+    {
+        columns[v] = 0;
+        for (int i = 0; i < 64; i++)
+        {
+            columns[v] |= (uint64_t)((i >> v) & 1) << i;
+        }
+        columnPtrs[v] = &columns[v];
+    }
+    const CondParserBatch batch = { .columns = columnPtrs, .numWords = 1 };
+
+    // cheap and expensive dispatch, the latter turning small rules into truth tables
+    const float instructionCosts[2] = { 0.1f, 20.0f };
+    const int numPrograms = sizeof(condParserTestPrograms) / sizeof(condParserTestPrograms[0]);
+
+    for (int c = 0; c < 2; c++)
+    {
+        const CondParserStats stats = { probability, cost, 6, instructionCosts[c] };
+
+        for (int i = 0; i < numPrograms; i++)
+        {
+            const char* expr = condParserTestPrograms[i];
+
+            unsigned char code[256];
+            CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+            ASSERT_TRUE_MSG(condParserCompilePlanned(expr, &symbols, &stats, condParserTestError, &program), expr);
+            ASSERT_TRUE(program.verified);
+
+            uint64_t batchResult;
+            condParserExecuteBatch(&program, &batch, &batchResult);
+
+            for (unsigned a = 0; a < 64; a++)
+            {
+                condParserTestAssignment = a;
+                bool expected = condParserEvaluate(expr, condParserTestGetAssigned, condParserTestError);
+
+                const uint64_t bits = a;
+                const CondParserEnv env = { .bits = &bits };
+                ASSERT_TRUE_MSG(condParserExecute(&program, &env) == expected, expr);
+                ASSERT_TRUE_MSG(((batchResult >> a) & 1) == expected, expr);
+            }
+        }
+    }
+
+    const CondParserStats stats = { probability, cost, 6, 0.1f };
+    unsigned char code[64];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+
+    // the operand most likely to end the chain goes first
+    ASSERT_TRUE(condParserCompilePlanned("a && b", &symbols, &stats, condParserTestError, &program));
+    ASSERT_EQ(code[0], CondParserOp_Slot);
+    ASSERT_EQ(code[1], 1);
+    ASSERT_TRUE(condParserCompilePlanned("b || a", &symbols, &stats, condParserTestError, &program));
+    ASSERT_EQ(code[1], 0);
+
+    // unless it is too expensive
+    ASSERT_TRUE(condParserCompilePlanned("d || f", &symbols, &stats, condParserTestError, &program));
+    ASSERT_EQ(code[1], 3);
+
+    const CondParserStats slowDispatch = { probability, cost, 6, 20.0f };
+    ASSERT_TRUE(condParserCompilePlanned("(a && b) || (c && !d)", &symbols, &slowDispatch, condParserTestError, &program));
+    ASSERT_EQ(code[0], CondParserOp_Table);
+    ASSERT_EQ(program.size, 11 + 2 * 4);
+
+    // without stats the source order is kept
+    ASSERT_TRUE(condParserCompilePlanned("a && b", &symbols, NULL, condParserTestError, &program));
+    ASSERT_EQ(code[1], 0);
+}
+
+UTEST(condparser, transpose) {
+    enum { numEnvs = 200, rowWords = 2, numSlots = 100, numWords = (numEnvs + 63) / 64 };
+
+    uint64_t rows[numEnvs * rowWords];
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < numEnvs * rowWords; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        rows[i] = state;
+    }
+
+    uint64_t columns[numSlots * numWords];
+    condParserTransposeRows(rows, rowWords, numEnvs, columns, numSlots);
+
+    for (int e = 0; e < numWords * 64; e++) {
+        for (int s = 0; s < numSlots; s++) {
+            uint64_t expected = e < numEnvs ? (rows[e * rowWords + s / 64] >> (s % 64)) & 1 : 0;
+            ASSERT_EQ((columns[s * numWords + e / 64] >> (e % 64)) & 1, expected);
+        }
+    }
+
+    // back to rows, the bits past the last slot are cleared
+    uint64_t back[numEnvs * rowWords];
+    condParserTransposeColumns(columns, numSlots, numEnvs, back, rowWords);
+    for (int e = 0; e < numEnvs; e++) {
+        ASSERT_EQ(back[e * rowWords], rows[e * rowWords]);
+        ASSERT_EQ(back[e * rowWords + 1], rows[e * rowWords + 1] & ((1ull << (numSlots - 64)) - 1));
+    }
+
+    // batch results scattered back into per-environment flags
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+    unsigned char code[64];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+    ASSERT_TRUE(condParserCompile("(a && !b) || atleast(2, c, d, e)", &symbols, condParserTestError, &program));
+
+    const uint64_t* columnPtrs[numSlots];
+    for (int s = 0; s < numSlots; s++) {
+        columnPtrs[s] = columns + s * numWords;
+    }
+    const CondParserBatch batch = { .columns = columnPtrs, .numWords = numWords };
+    uint64_t results[numWords];
+    condParserExecuteBatch(&program, &batch, results);
+
+    uint64_t flags[numEnvs];
+    condParserTransposeColumns(results, 1, numEnvs, flags, 1);
+    for (int e = 0; e < numEnvs; e++) {
+        const CondParserEnv env = { .bits = rows + e * rowWords };
+        ASSERT_EQ(flags[e], (uint64_t)condParserExecute(&program, &env));
+    }
+}
+
+int condParserTestGetNumbered(const char* id)
+{
+    return id[0] == 's' ? atoi(id + 1) : -1;
+}
+
+static bool condParserTestBit(const uint8_t* bitmap, int64_t i)
+{
+    return (bitmap[i >> 3] >> (i & 7)) & 1;
+}
+
+UTEST(condparser, arrow) {
+    enum { length = 300, numBytes = (length + 7) / 8 };
+
+    // six boolean arrays at odd offsets, the second and fourth with nulls, and a dictionary encoded gpu field
+    uint8_t values[6][numBytes + 8];
+    uint8_t validity[2][numBytes + 8];
+    int32_t gpu[length + 5];
+    uint8_t gpuValidity[numBytes + 8];
+
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    for (int i = 0; i < length + 5; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        ((uint8_t*)values)[i % sizeof(values)] = (uint8_t)state;
+        ((uint8_t*)validity)[i % sizeof(validity)] = (uint8_t)(state >> 8) | (uint8_t)(state >> 16);
+        gpuValidity[i % sizeof(gpuValidity)] = (uint8_t)(state >> 24) | (uint8_t)(state >> 32);
+        gpu[i] = (int32_t)((state >> 40) & 3);
+    }
+
+    CondParserArrowArray columns[6];
+    for (int s = 0; s < 6; s++) {
+        const CondParserArrowArray column = { values[s], s == 1 || s == 3 ? validity[s / 2] : NULL, s + 3 };
+        columns[s] = column;
+    }
+    const CondParserArrowArray fields[1] = { { gpu, gpuValidity, 5 } };
+    const CondParserArrowBatch batch = { columns, fields, length };
+
+    const struct {
+        const char* expr;
+        unsigned reads;     // slots read, the gpu field as bit 6
+    } tests[] = {
+        { "a && !b", 0x03 },
+        { "atleast(2, gpu in (nvidia), b, d) || f", 0x6a },
+        { "!(gpu in (amd, intel)) && (c || e)", 0x54 }
+    };
+
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot, .getField = condParserTestGetField, .getEnumerator = condParserTestGetEnumerator };
+    for (int t = 0; t < (int)(sizeof(tests) / sizeof(tests[0])); t++) {
+        unsigned char code[128];
+        CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+        ASSERT_TRUE(condParserCompile(tests[t].expr, &symbols, condParserTestError, &program));
+
+        uint8_t result[numBytes + 1];
+        uint8_t resultValidity[numBytes + 1];
+        memset(result, 0xcc, sizeof(result));
+        condParserExecuteArrow(&program, &batch, CondParserNulls_False, result, NULL);
+
+        uint8_t unknown[numBytes + 1];
+        condParserExecuteArrow(&program, &batch, CondParserNulls_Unknown, unknown, resultValidity);
+
+        for (int64_t r = 0; r < length; r++) {
+            uint64_t bits = 0;
+            bool valid = true;
+            for (int s = 0; s < 6; s++) {
+                bool slotValid = columns[s].validity == NULL || condParserTestBit(columns[s].validity, r + s + 3);
+                bits |= (uint64_t)(slotValid && condParserTestBit(values[s], r + s + 3)) << s;
+                valid = valid && (slotValid || !((tests[t].reads >> s) & 1));
+            }
+            bool gpuValid = condParserTestBit(gpuValidity, r + 5);
+            const int32_t field = gpuValid ? gpu[r + 5] : -1;
+            valid = valid && (gpuValid || !((tests[t].reads >> 6) & 1));
+
+            const CondParserEnv env = { &bits, &field };
+            bool expected = condParserExecute(&program, &env);
+            ASSERT_EQ(condParserTestBit(result, r), expected);
+            ASSERT_EQ(condParserTestBit(resultValidity, r), valid);
+            ASSERT_EQ(condParserTestBit(unknown, r), valid && expected);
+        }
+
+        // padding bits are cleared and nothing is written past the bitmap
+        ASSERT_EQ(result[numBytes - 1] >> (length % 8), 0);
+        ASSERT_EQ(result[numBytes], 0xcc);
+    }
+
+    // slots far apart, marked a window at a time
+    static CondParserArrowArray wide[3001];
+    wide[3] = columns[1];
+    wide[3000] = columns[3];
+    const CondParserArrowBatch wideBatch = { wide, NULL, length };
+    const CondParserSymbols numbered = { .getSlot = condParserTestGetNumbered };
+    unsigned char code[64];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+    ASSERT_TRUE(condParserCompile("s3 || s3000", &numbered, condParserTestError, &program));
+
+    uint8_t result[numBytes + 1];
+    uint8_t resultValidity[numBytes + 1];
+    condParserExecuteArrow(&program, &wideBatch, CondParserNulls_Unknown, result, resultValidity);
+    for (int64_t r = 0; r < length; r++) {
+        bool valid = condParserTestBit(validity[0], r + 4) && condParserTestBit(validity[1], r + 6);
+        bool expected = condParserTestBit(values[1], r + 4) || condParserTestBit(values[3], r + 6);
+        ASSERT_EQ(condParserTestBit(resultValidity, r), valid);
+        ASSERT_EQ(condParserTestBit(result, r), valid && expected);
+    }
+}
+
+// integer identifiers "mem" and "temp" next to the enumerated "gpu"
+static int32_t condParserTestMem;
+static int32_t condParserTestTemp;
+
+int32_t condParserTestGetNumber(const char* id)
+{
+    return strcmp(id, "mem") == 0 ? condParserTestMem : condParserTestTemp;
+}
+
+int condParserTestGetNumericField(const char* id)
+{
+    return strcmp(id, "mem") == 0 ? 1 : strcmp(id, "temp") == 0 ? 2 : condParserTestGetField(id);
+}
+
+UTEST(condparser, comparison) {
+    const CondParserCallbacks callbacks = { condParserTestGetAssigned, condParserTestGetEnum, condParserTestError, condParserTestGetNumber };
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot, .getField = condParserTestGetNumericField, .getEnumerator = condParserTestGetEnumerator };
+
+    const char* exprs[] = {
+        "mem >= 4096",
+        "mem < 4096 || temp <= -5",
+        "temp == -10 && a",
+        "!(mem > 100) && mem >= -3",
+        "atleast(2, mem == 0, temp > 30, a)",
+        "gpu in (amd) && mem>2048",
+        "mem <= 2147483 && temp >= -999999999"
+    };
+    const int32_t samples[] = { INT32_MIN, -999999999, -10, -5, -4, -3, 0, 30, 31, 100, 101, 2048, 2049, 4095, 4096, INT32_MAX };
+    const int numSamples = sizeof(samples) / sizeof(samples[0]);
+
+    // environment e: mem and temp from the samples, a from bit 0, gpu cycling through its values
+    enum { numEnvs = 256, numWords = numEnvs / 64 };
+    int32_t fields[3][numEnvs];
+    uint64_t column[numWords] = { 0 };
+    for (int e = 0; e < numEnvs; e++) {
+        fields[0][e] = e % 3;
+        fields[1][e] = samples[e % numSamples];
+        fields[2][e] = samples[(e / numSamples) % numSamples];
+        column[e / 64] |= (uint64_t)(e & 1) << (e % 64);
+    }
+
+    const uint64_t* columns[1] = { column };
+    const int32_t* fieldPtrs[3] = { fields[0], fields[1], fields[2] };
+    const CondParserBatch batch = { columns, numWords, fieldPtrs };
+
+    const CondParserArrowArray arrowColumns[1] = { { column, NULL, 0 } };
+    const CondParserArrowArray arrowFields[3] = { { fields[0], NULL, 0 }, { fields[1], NULL, 0 }, { fields[2], NULL, 0 } };
+    const CondParserArrowBatch arrow = { arrowColumns, arrowFields, numEnvs - 3 };
+
+    for (int i = 0; i < (int)(sizeof(exprs) / sizeof(exprs[0])); i++) {
+        unsigned char code[128];
+        CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+        ASSERT_TRUE_MSG(condParserCompile(exprs[i], &symbols, condParserTestError, &program), exprs[i]);
+
+        uint64_t results[numWords];
+        condParserExecuteBatch(&program, &batch, results);
+        uint8_t arrowResults[numEnvs / 8];
+        condParserExecuteArrow(&program, &arrow, CondParserNulls_False, arrowResults, NULL);
+
+        for (int e = 0; e < numEnvs; e++) {
+            condParserTestAssignment = (unsigned)(e & 1);
+            condParserTestGpu = fields[0][e];
+            condParserTestMem = fields[1][e];
+            condParserTestTemp = fields[2][e];
+            bool expected = condParserEvaluateEx(exprs[i], &callbacks);
+
+            const uint64_t bits = (uint64_t)(e & 1);
+            const int32_t envFields[3] = { fields[0][e], fields[1][e], fields[2][e] };
+            const CondParserEnv env = { &bits, envFields };
+            ASSERT_TRUE_MSG(condParserExecute(&program, &env) == expected, exprs[i]);
+            ASSERT_TRUE_MSG(((results[e / 64] >> (e % 64)) & 1) == expected, exprs[i]);
+            if (e < numEnvs - 3) {
+                ASSERT_TRUE_MSG(((arrowResults[e / 8] >> (e % 8)) & 1) == expected, exprs[i]);
+            }
+        }
+    }
+
+    // spot checks against hand-computed values
+    condParserTestMem = 4096;
+    condParserTestTemp = -5;
+    ASSERT_TRUE(condParserEvaluateEx("mem >= 4096 && temp <= -5 && !(mem < 4096) && temp == -5", &callbacks));
+    ASSERT_FALSE(condParserEvaluateEx("mem > 4096 || temp < -5 || temp >= -4", &callbacks));
+
+    unsigned char code[64];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+    ASSERT_FALSE(condParserCompile("mem <", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("mem < temp", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("mem < 1234567890", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("atleast(-1, a, b)", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("size > 3", &symbols, NULL, &program));
+
+    CondParserTokenSpan tokens[8];
+    ASSERT_EQ(condParserTokenize("mem>=-5", tokens, 8, condParserTestError), 4);
+    ASSERT_EQ((int)tokens[1].type, (int)CondParserToken_GreaterEqual);
+    ASSERT_EQ((int)tokens[2].type, (int)CondParserToken_Number);
+    ASSERT_EQ(tokens[2].number, -5);
+    ASSERT_EQ(tokens[2].length, 2);
+}
+
+UTEST(condparser, logicOps) {
+    const struct
+    {
+        const char* expr;
+        bool expected;
+        int calls;
+    } tests[] = {
+        { "true ^ x", true, 1 },
+        { "true ^ true ^ true", true, 0 },
+        { "x == false && true != x", true, 2 },
+        { "false -> (x || y)", true, 0 },
+        { "x -> y", true, 1 },
+        { "true -> x -> y", true, 1 },
+        { "true ? x : y", false, 1 },
+        { "false ? x : true", true, 0 },
+        { "true ? false ? a : b : c", false, 1 },
+        { "false ? a ? b : c : true ? d : e", false, 1 },
+        { "false && a ? b : c", false, 1 },
+        { "true || a -> b", false, 1 },
+        { "atleast(1, false ? a : b, true) && (true ? true : (x))", true, 1 }
+    };
+
+    const int numTests = sizeof(tests) / sizeof(tests[0]);
+
+    for (int i = 0; i < numTests; i++)
+    {
+        condParserTestCalls = 0;
+        bool res = condParserEvaluate(tests[i].expr, condParserTestCountingGetValue, condParserTestError);
+        ASSERT_TRUE_MSG(res == tests[i].expected, tests[i].expr);
+        ASSERT_EQ_MSG(condParserTestCalls, tests[i].calls, tests[i].expr);
+    }
+
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+    unsigned char code[64];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+
+    // one instruction each, constant operands fold into the other operand
+    ASSERT_TRUE(condParserCompile("a ? b : c", &symbols, condParserTestError, &program));
+    ASSERT_EQ(program.size, 10);
+    ASSERT_EQ(code[9], CondParserOp_Select);
+    ASSERT_TRUE(condParserCompile("a -> b", &symbols, condParserTestError, &program));
+    ASSERT_EQ(code[6], CondParserOp_Implies);
+    ASSERT_TRUE(condParserCompile("a ^ true", &symbols, condParserTestError, &program));
+    ASSERT_EQ(program.size, 4);
+    ASSERT_EQ(code[3], CondParserOp_Not);
+    ASSERT_TRUE(condParserCompile("c ? d : false", &symbols, condParserTestError, &program));
+    ASSERT_EQ(code[6], CondParserOp_And);
+    ASSERT_TRUE(condParserCompile("b -> true", &symbols, condParserTestError, &program));
+    ASSERT_EQ(program.size, 1);
+    ASSERT_EQ(code[0], CondParserOp_True);
+
+    ASSERT_FALSE(condParserCompile("a ? b", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("a ->", &symbols, NULL, &program));
+    ASSERT_FALSE(condParserCompile("? a : b", &symbols, NULL, &program));
+
+    CondParserTokenSpan tokens[16];
+    ASSERT_EQ(condParserTokenize("a->b?c:d^e!=!f", tokens, 16, condParserTestError), 13);
+    ASSERT_EQ((int)tokens[1].type, (int)CondParserToken_Implies);
+    ASSERT_EQ((int)tokens[3].type, (int)CondParserToken_Question);
+    ASSERT_EQ((int)tokens[5].type, (int)CondParserToken_Colon);
+    ASSERT_EQ((int)tokens[7].type, (int)CondParserToken_Xor);
+    ASSERT_EQ((int)tokens[9].type, (int)CondParserToken_NotEqual);
+    ASSERT_EQ((int)tokens[10].type, (int)CondParserToken_Not);
+}
+
+UTEST(condparser, ruleCursor) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+
+    const char* rules[] = {
+        "a && b && c",
+        "a",
+        "a && b",
+        "a || d",
+        "e && !f",
+        "atleast(2, b, c, e)",
+        "b && a",
+        "c ? d : f"
+    };
+    const int numRules = sizeof(rules) / sizeof(rules[0]);
+
+    unsigned char code[8][64];
+    CondParserProgram programs[8];
+    CondParserRuleInfo info[8];
+    for (int r = 0; r < numRules; r++)
+    {
+        CondParserProgram program = { .code = code[r], .capacity = sizeof(code[r]) };
+        ASSERT_TRUE_MSG(condParserCompile(rules[r], &symbols, condParserTestError, &program), rules[r]);
+        programs[r] = program;
+    }
+
+    int order[8];
+    uint64_t settleTrue[8];
+    uint64_t settleFalse[8];
+    CondParserRuleset ruleset = { .rules = programs, .info = info, .numRules = numRules, .order = order, .settleTrue = settleTrue, .settleFalse = settleFalse };
+    condParserAnalyzeRuleset(&ruleset, 100000);
+
+    uint64_t bits = 0;
+    uint64_t results = 0;
+    uint64_t pending;
+    CondParserRuleCursor cursor;
+    condParserRuleCursorInit(&cursor, &ruleset, &pending);
+    ASSERT_EQ(cursor.numPending, numRules);
+
+    // flip one slot per frame, spending at most one execution per call
+    int totalExecuted = 0;
+    for (int frame = 0; frame < 64; frame++)
+    {
+        const CondParserEnv env = { .bits = &bits };
+        int calls = 0;
+        while (condParserResumeRuleset(&ruleset, &cursor, &env, &results, 1) > 0)
+        {
+            calls++;
+            ASSERT_LE(calls, numRules);
+        }
+        totalExecuted += calls + 1;
+
+        uint64_t expected;
+        condParserExecuteRuleset(&ruleset, &env, &expected);
+        ASSERT_EQ(results, expected);
+
+        const uint64_t changed = 1ull << ((frame * 7) % 6);
+        bits ^= changed;
+        condParserRuleCursorInvalidate(&cursor, &ruleset, &changed, 6, NULL, 0);
+        ASSERT_LT(cursor.numPending, numRules);
+    }
+
+    // only the rules reading the flipped slot are evaluated again
+    ASSERT_LT(totalExecuted, 64 * numRules / 2);
+
+    // slots no rule reads leave every result valid
+    const uint64_t unread = 1ull << 10;
+    const int numPending = cursor.numPending;
+    condParserRuleCursorInvalidate(&cursor, &ruleset, &unread, 11, NULL, 0);
+    ASSERT_EQ(cursor.numPending, numPending);
+}
+
+UTEST(condparser, speculate) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot, .getField = condParserTestGetNumericField };
+
+    unsigned char code[64];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+    ASSERT_TRUE(condParserCompile("a && (b || c) || mem > 100", &symbols, condParserTestError, &program));
+
+    // c is still pending, but the result doesn't read it while b is true
+    uint64_t bits = 0x7;
+    int32_t fields[3] = { 0, 50, 0 };
+    const CondParserEnv env = { &bits, fields };
+    const uint64_t pendingSlots = 0x6;
+    uint64_t slotDeps;
+    uint64_t fieldDeps;
+    CondParserSpeculation speculation = { .slots = &slotDeps, .fields = &fieldDeps };
+
+    ASSERT_TRUE(condParserSpeculate(&program, &env, &pendingSlots, NULL, &speculation));
+    ASSERT_EQ(slotDeps, 0x2ull);
+    ASSERT_EQ(fieldDeps, 0ull);
+
+    // c arrives false, which the result didn't depend on
+    uint64_t changed = 0x4;
+    bits ^= changed;
+    ASSERT_FALSE(condParserConfirm(&program, &env, &changed, NULL, &speculation));
+    ASSERT_TRUE(speculation.result);
+
+    // b arrives false, so the result changes
+    const uint64_t pendingField = 0x2;
+    ASSERT_TRUE(condParserSpeculate(&program, &env, &pendingSlots, &pendingField, &speculation));
+    changed = 0x2;
+    bits ^= changed;
+    ASSERT_TRUE(condParserConfirm(&program, &env, &changed, NULL, &speculation));
+    ASSERT_FALSE(speculation.result);
+    ASSERT_EQ(slotDeps, 0ull);
+
+    // with b false, c and mem are read too
+    ASSERT_FALSE(condParserSpeculate(&program, &env, &pendingSlots, &pendingField, &speculation));
+    ASSERT_EQ(slotDeps, 0x6ull);
+    ASSERT_EQ(fieldDeps, 0x2ull);
+    fields[1] = 200;
+    const uint64_t changedField = 0x2;
+    ASSERT_TRUE(condParserConfirm(&program, &env, NULL, &changedField, &speculation));
+    ASSERT_TRUE(speculation.result);
+}
+
+UTEST(condparser, kleene) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+
+    // every slot of a..f is false, true or unknown: environment e holds digit v of e in base 3 in slot v
+    enum { numEnvs = 729, numWords = (numEnvs + 63) / 64 };
+    uint64_t values[6][numWords] = { { 0 } };
+    uint64_t knownBits[6][numWords] = { { 0 } };
+    const uint64_t* columns[6];
+    const uint64_t* knownColumns[6];
+    for (int v = 0, digit = 1; v < 6; v++, digit *= 3)
+    {
+        for (int e = 0; e < numEnvs; e++)
+        {
+            values[v][e / 64] |= (uint64_t)((e / digit) % 3 == 1) << (e % 64);
+            knownBits[v][e / 64] |= (uint64_t)((e / digit) % 3 != 2) << (e % 64);
+        }
+        columns[v] = values[v];
+        knownColumns[v] = knownBits[v];
+    }
+    const CondParserBatch batch = { .columns = columns, .numWords = numWords };
+    const CondParserKnown known = { .columns = knownColumns };
+
+    // each slot read once, where Kleene logic is exact
+    const char* exact[] = {
+        "a && (b || !c)",
+        "atleast(2, a, b, c)",
+        "atmost(1, a, b, !c) && d",
+        "exactly(1, a, b, c) || d",
+        "a ^ b",
+        "a == !b",
+        "a -> b",
+        "a ? b : c"
+    };
+    const int numExact = sizeof(exact) / sizeof(exact[0]);
+    const int numPrograms = sizeof(condParserTestPrograms) / sizeof(condParserTestPrograms[0]);
+
+    for (int i = 0; i < numExact + numPrograms; i++)
+    {
+        const char* expr = i < numExact ? exact[i] : condParserTestPrograms[i - numExact];
+
+        unsigned char code[256];
+        CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+        ASSERT_TRUE_MSG(condParserCompile(expr, &symbols, condParserTestError, &program), expr);
+
+        uint64_t isTrue[numWords], isFalse[numWords], isUnknown[numWords];
+        condParserExecuteKleene(&program, &batch, &known, isTrue, isFalse, isUnknown);
+
+        for (int e = 0; e < numEnvs; e++)
+        {
+            // evaluate every completion of the unknown slots
+            unsigned value = 0, unknown = 0;
+            for (int v = 0; v < 6; v++)
+            {
+                value |= (unsigned)((values[v][e / 64] >> (e % 64)) & 1) << v;
+                unknown |= (unsigned)(!((knownBits[v][e / 64] >> (e % 64)) & 1)) << v;
+            }
+
+            bool allTrue = true, allFalse = true;
+            for (unsigned completion = 0; completion < 64; completion++)
+            {
+                if ((completion & ~unknown) != 0) continue;
+                const uint64_t bits = value | completion;
+                const CondParserEnv env = { .bits = &bits };
+                bool result = condParserExecute(&program, &env);
+                allTrue = allTrue && result;
+                allFalse = allFalse && !result;
+            }
+
+            bool t = (isTrue[e / 64] >> (e % 64)) & 1;
+            bool f = (isFalse[e / 64] >> (e % 64)) & 1;
+            ASSERT_TRUE_MSG(!(t && f) && ((isUnknown[e / 64] >> (e % 64)) & 1) == (!t && !f), expr);
+            ASSERT_TRUE_MSG(!t || allTrue, expr);
+            ASSERT_TRUE_MSG(!f || allFalse, expr);
+            if (i < numExact || unknown == 0)
+            {
+                ASSERT_TRUE_MSG(t == allTrue && f == allFalse, expr);
+            }
+        }
+    }
+
+    // truth tables give the same planes as the instructions they replace
+    const float probability[6] = { 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f };
+    const float cost[6] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+    const CondParserStats stats = { probability, cost, 6, 20.0f };
+    unsigned char code[64], tableCode[64];
+    CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+    CondParserProgram table = { .code = tableCode, .capacity = sizeof(tableCode) };
+    ASSERT_TRUE(condParserCompile("a || b && !c", &symbols, condParserTestError, &program));
+    ASSERT_TRUE(condParserCompilePlanned("a || b && !c", &symbols, &stats, condParserTestError, &table));
+    ASSERT_EQ(tableCode[0], CondParserOp_Table);
+
+    uint64_t isTrue[numWords], isFalse[numWords], tableTrue[numWords], tableFalse[numWords];
+    condParserExecuteKleene(&program, &batch, &known, isTrue, isFalse, NULL);
+    condParserExecuteKleene(&table, &batch, &known, tableTrue, tableFalse, NULL);
+    ASSERT_EQ(memcmp(isTrue, tableTrue, sizeof(isTrue)), 0);
+    ASSERT_EQ(memcmp(isFalse, tableFalse, sizeof(isFalse)), 0);
+
+    // Arrow validity bitmaps are the known planes
+
+    CondParserArrowArray arrowColumns[6];
+    for (int v = 0; v < 6; v++)
+    {
+        const CondParserArrowArray array = { values[v], (const uint8_t*)knownBits[v], 0 };
+        arrowColumns[v] = array;
+    }
+    const CondParserArrowBatch arrow = { arrowColumns, NULL, numEnvs };
+
+    uint8_t result[numWords * 8], validity[numWords * 8];
+    condParserExecuteArrow(&program, &arrow, CondParserNulls_Kleene, result, validity);
+    for (int e = 0; e < numEnvs; e++)
+    {
+        ASSERT_EQ(condParserTestBit(result, e), (bool)((isTrue[e / 64] >> (e % 64)) & 1));
+        ASSERT_EQ(condParserTestBit(validity, e), (bool)(((isTrue[e / 64] | isFalse[e / 64]) >> (e % 64)) & 1));
+    }
+}
+
+UTEST(condparser, interner) {
+    uint64_t buckets[512];
+    const char* names[256];
+    char chars[2048];
+    CondParserInterner interner;
+    condParserInternerInit(&interner, buckets, 512, names, 256, chars, sizeof(chars));
+
+    // slots are handed out in first-come order and stay put
+    ASSERT_EQ(condParserIntern(&interner, "a", 1), 0);
+    ASSERT_EQ(condParserIntern(&interner, "bcd", 3), 1);
+    ASSERT_EQ(condParserIntern(&interner, "abc", 1), 0);
+    ASSERT_EQ(condParserInternerSlot(&interner, "bcd", 3), 1);
+    ASSERT_EQ(condParserInternerSlot(&interner, "bc", 2), -1);
+    ASSERT_STREQ(condParserInternerName(&interner, 1), "bcd");
+    ASSERT_TRUE(condParserInternerName(&interner, 2) == NULL);
+
+    // programs compiled separately share the slot space
+    const CondParserSymbols symbols = { .interner = &interner };
+    unsigned char code1[64], code2[64];
+    CondParserProgram first = { .code = code1, .capacity = sizeof(code1) };
+    CondParserProgram second = { .code = code2, .capacity = sizeof(code2) };
+    ASSERT_TRUE(condParserCompile("x && !bcd", &symbols, condParserTestError, &first));
+    ASSERT_TRUE(condParserCompile("y || x", &symbols, condParserTestError, &second));
+    ASSERT_EQ(condParserInternerSlot(&interner, "x", 1), 2);
+    ASSERT_EQ(condParserInternerSlot(&interner, "y", 1), 3);
+    ASSERT_EQ(second.numSlots, 4);
+
+    uint64_t bits = 1ull << 2;
+    const CondParserEnv env = { .bits = &bits };
+    ASSERT_TRUE(condParserExecute(&first, &env));
+    ASSERT_TRUE(condParserExecute(&second, &env));
+
+    // running out of slots fails the insert but keeps existing names
+    uint64_t smallBuckets[8];
+    const char* smallNames[2];
+    char smallChars[64];
+    CondParserInterner small;
+    condParserInternerInit(&small, smallBuckets, 8, smallNames, 2, smallChars, sizeof(smallChars));
+    ASSERT_EQ(condParserIntern(&small, "p", 1), 0);
+    ASSERT_EQ(condParserIntern(&small, "q", 1), 1);
+    ASSERT_EQ(condParserIntern(&small, "r", 1), -1);
+    ASSERT_EQ(condParserIntern(&small, "q", 1), 1);
+    ASSERT_EQ(condParserInternerSlot(&small, "r", 1), -1);
+    ASSERT_EQ(small.numChars, 4);
+
+    // failed inserts reuse their bucket instead of filling the table
+    for (int i = 0; i < 20; i++) {
+        ASSERT_EQ(condParserIntern(&small, "r", 1), -1);
+    }
+    int usedBuckets = 0;
+    for (int i = 0; i < 8; i++) {
+        usedBuckets += smallBuckets[i] != 0;
+    }
+    ASSERT_EQ(usedBuckets, 3);
+
+    // capacities that aren't a power of two use their largest one
+    uint64_t oddBuckets[7];
+    const char* oddNames[2];
+    char oddChars[8];
+    CondParserInterner odd;
+    condParserInternerInit(&odd, oddBuckets, 7, oddNames, 2, oddChars, sizeof(oddChars));
+    ASSERT_EQ(odd.capacity, 4);
+    ASSERT_EQ(condParserIntern(&odd, "p", 1), 0);
+    ASSERT_EQ(condParserIntern(&odd, "q", 1), 1);
+    ASSERT_EQ(condParserInternerSlot(&odd, "p", 1), 0);
+    ASSERT_EQ(condParserInternerSlot(&odd, "q", 1), 1);
+
+    // running out of chars gives the slot back
+    uint64_t tightBuckets[8];
+    const char* tightNames[2];
+    char tightChars[6];
+    CondParserInterner tight;
+    condParserInternerInit(&tight, tightBuckets, 8, tightNames, 2, tightChars, sizeof(tightChars));
+    ASSERT_EQ(condParserIntern(&tight, "abc", 3), 0);
+    ASSERT_EQ(condParserIntern(&tight, "de", 2), -1);
+    ASSERT_EQ(tight.numSlots, 1);
+    ASSERT_EQ(condParserIntern(&tight, "f", 1), 1);
+    ASSERT_STREQ(condParserInternerName(&tight, 1), "f");
+    const CondParserSymbols smallSymbols = { .interner = &small };
+    ASSERT_FALSE(condParserCompile("p && s", &smallSymbols, NULL, &first));
+}
+
+UTEST(condparser, scoring) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetSlot };
+    const char* rules[] = {
+        "a && b",
+        "a || !a",
+        "b && a",
+        "c ^ d",
+        "atleast(2, a, c, e, f)",
+        "c && !c",
+        "e ? f : !a",
+        "!(a && b)"
+    };
+    const float weights[] = { 1.5f, 0.25f, 2.0f, -3.0f, 4.0f, 100.0f, 0.5f, 8.0f };
+    const int numRules = sizeof(rules) / sizeof(rules[0]);
+
+    unsigned char code[8][128];
+    CondParserProgram programs[8];
+    CondParserRuleInfo info[8];
+    for (int r = 0; r < numRules; r++)
+    {
+        CondParserProgram program = { .code = code[r], .capacity = sizeof(code[r]) };
+        ASSERT_TRUE_MSG(condParserCompile(rules[r], &symbols, condParserTestError, &program), rules[r]);
+        programs[r] = program;
+    }
+
+    CondParserRuleset ruleset = { programs, info, numRules, NULL, NULL, NULL, weights };
+    condParserAnalyzeRuleset(&ruleset, 100000);
+    ASSERT_EQ(info[2].shared, 0);
+
+    // a single environment scores the weights of the rules it matches
+    uint64_t bits = 0x3, results;
+    const CondParserEnv single = { .bits = &bits };
+    ASSERT_EQ(condParserScoreRuleset(&ruleset, &single, &results), 1.5f + 0.25f + 2.0f);
+    ASSERT_EQ(results, 0x7ull);
+
+    // every environment of a batch scores the same as on its own
+    enum { numWords = 4, numEnvs = numWords * 64 };
+    uint64_t columns[6][numWords];
+    const uint64_t* columnPtrs[6];
+    uint64_t envBits[numEnvs];
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (int e = 0; e < numEnvs; e++)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        envBits[e] = state >> 58;
+    }
+    for (int v = 0; v < 6; v++)
+    {
+        for (int w = 0; w < numWords; w++)
+        {
+            columns[v][w] = 0;
+            for (int i = 0; i < 64; i++)
+            {
+                columns[v][w] |= ((envBits[w * 64 + i] >> v) & 1) << i;
+            }
+        }
+        columnPtrs[v] = columns[v];
+    }
+    const CondParserBatch batch = { columnPtrs, numWords, NULL };
+
+    uint64_t ruleWords[8];
+    float scores[numEnvs];
+    condParserScoreBatch(&ruleset, &batch, ruleWords, scores);
+    for (int e = 0; e < numEnvs; e++)
+    {
+        const CondParserEnv env = { .bits = &envBits[e] };
+        ASSERT_EQ(scores[e], condParserScoreRuleset(&ruleset, &env, &results));
+    }
+}
+
+UTEST(condparser, versions) {
+    uint64_t words[256];
+    const uint64_t* pointers[64];
+    CondParserVersionArena arena;
+    condParserVersionArenaInit(&arena, words, 256, pointers, 64);
+
+    // three chunks, the last two all zero and shared
+    uint64_t bits[10] = { 0x3 };
+    CondParserVersion v0;
+    ASSERT_TRUE(condParserVersionInit(&v0, &arena, bits, 600));
+    ASSERT_TRUE(v0.chunks[1] == v0.chunks[2]);
+    ASSERT_EQ(arena.numWords, 2 * CONDPARSER_VERSION_CHUNK_WORDS);
+
+    // a change copies the chunk table and the changed chunk only
+    const int slots[3] = { 1, 300, 599 };
+    const bool values[3] = { false, true, true };
+    CondParserVersion v1, v2;
+    ASSERT_TRUE(condParserVersionSet(&v1, &v0, &arena, slots, values, 1));
+    ASSERT_TRUE(condParserVersionSet(&v2, &v1, &arena, slots + 1, values + 1, 2));
+    ASSERT_TRUE(v1.chunks[0] != v0.chunks[0]);
+    ASSERT_TRUE(v1.chunks[1] == v0.chunks[1]);
+    ASSERT_TRUE(v2.chunks[0] == v1.chunks[0]);
+    ASSERT_TRUE(v2.chunks[1] != v2.chunks[2]);
+
+    // older versions are untouched
+    ASSERT_TRUE(condParserVersionGet(&v0, 1));
+    ASSERT_FALSE(condParserVersionGet(&v1, 1));
+    ASSERT_FALSE(condParserVersionGet(&v1, 300));
+    ASSERT_TRUE(condParserVersionGet(&v2, 300));
+    ASSERT_TRUE(condParserVersionGet(&v2, 599));
+    ASSERT_FALSE(condParserVersionGet(&v2, 600));
+
+    // programs give the same results as on a flat bitset
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetNumbered };
+    const char* exprs[] = { "s0 && s1", "s0 && !s1", "s0 && s300", "s599 || s1", "s700 || s0 && !s1" };
+    const CondParserVersion* versions[3] = { &v0, &v1, &v2 };
+    for (int i = 0; i < 5; i++)
+    {
+        unsigned char code[64];
+        CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+        ASSERT_TRUE_MSG(condParserCompile(exprs[i], &symbols, condParserTestError, &program), exprs[i]);
+
+        for (int v = 0; v < 3; v++)
+        {
+            uint64_t flat[12] = { 0 };
+            for (int slot = 0; slot < 600; slot++)
+            {
+                flat[slot >> 6] |= (uint64_t)condParserVersionGet(versions[v], slot) << (slot & 63);
+            }
+            const CondParserEnv env = { .bits = flat };
+            ASSERT_EQ_MSG(condParserExecuteVersion(&program, versions[v], NULL), condParserExecute(&program, &env), exprs[i]);
+        }
+    }
+
+    // wide programs read every word through the chunk table, threshold masks included
+    uint64_t wideWords[64];
+    const uint64_t* widePointers[64];
+    CondParserVersionArena wideArena;
+    condParserVersionArenaInit(&wideArena, wideWords, 64, widePointers, 64);
+    uint64_t wideBits[94] = { 0x1 };
+    CondParserVersion w0, w1;
+    ASSERT_TRUE(condParserVersionInit(&w0, &wideArena, wideBits, 6000));
+    const int wideSlots[2] = { 0, 5000 };
+    const bool wideValues[2] = { false, true };
+    ASSERT_TRUE(condParserVersionSet(&w1, &w0, &wideArena, wideSlots, wideValues, 2));
+
+    const char* wideExprs[] = { "s0 && !s5000", "!s0 && s5000", "atleast(2, s5000, s5001, s0)", "s7000 || s4999" };
+    for (int i = 0; i < 4; i++)
+    {
+        unsigned char code[64];
+        CondParserProgram program = { .code = code, .capacity = sizeof(code) };
+        ASSERT_TRUE_MSG(condParserCompile(wideExprs[i], &symbols, condParserTestError, &program), wideExprs[i]);
+        ASSERT_EQ_MSG(condParserExecuteVersion(&program, &w0, NULL), i == 0, wideExprs[i]);
+        ASSERT_EQ_MSG(condParserExecuteVersion(&program, &w1, NULL), i == 1, wideExprs[i]);
+    }
+
+    // running out of arena leaves it as it was
+    int numWords = arena.numWords;
+    const int many[3] = { 2, 260, 520 };
+    const bool set[3] = { true, true, true };
+    CondParserVersionArena small;
+    condParserVersionArenaInit(&small, words + numWords, 2 * CONDPARSER_VERSION_CHUNK_WORDS, pointers + arena.numPointers, 16);
+    ASSERT_FALSE(condParserVersionSet(&v1, &v2, &small, many, set, 3));
+    ASSERT_EQ(small.numWords, 0);
+    ASSERT_EQ(small.numPointers, 0);
+    ASSERT_TRUE(condParserVersionSet(&v1, &v2, &small, many, set, 2));
+    ASSERT_TRUE(condParserVersionGet(&v1, 260));
+}
+
+UTEST(condparser, dedup) {
+    enum { numEnvs = 1000, rowWords = 3 };
+    uint64_t rows[numEnvs * rowWords];
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    for (int i = 0; i < numEnvs * rowWords; i++)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        rows[i] = state ^ (state >> 29);
+    }
+
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetNumbered };
+    unsigned char code1[64], code2[64];
+    CondParserProgram first = { .code = code1, .capacity = sizeof(code1) };
+    CondParserProgram second = { .code = code2, .capacity = sizeof(code2) };
+    ASSERT_TRUE(condParserCompile("s3 && !s70 || s150", &symbols, condParserTestError, &first));
+    ASSERT_TRUE(condParserCompile("atleast(2, s3, s64, s65)", &symbols, condParserTestError, &second));
+
+    int buckets[2048], groups[numEnvs], representatives[numEnvs];
+    CondParserDedup dedup = { .buckets = buckets, .capacity = 2048, .groups = groups, .representatives = representatives };
+
+    // a rule reading 3 slots splits the rows into at most 8 groups
+    uint64_t mask[rowWords] = { 0 };
+    ASSERT_TRUE(condParserProjectionMask(&first, mask));
+    ASSERT_EQ(mask[0], 1ull << 3);
+    ASSERT_EQ(condParserDedupRows(mask, rowWords, rows, rowWords, numEnvs, &dedup), 8);
+
+    uint64_t groupResults[1] = { 0 };
+    for (int g = 0; g < dedup.numGroups; g++)
+    {
+        const CondParserEnv env = { .bits = rows + representatives[g] * rowWords };
+        groupResults[0] |= (uint64_t)condParserExecute(&first, &env) << g;
+    }
+
+    uint64_t results[(numEnvs + 63) / 64];
+    condParserScatterGroups(&dedup, numEnvs, groupResults, results);
+    for (int e = 0; e < numEnvs; e++)
+    {
+        const CondParserEnv env = { .bits = rows + e * rowWords };
+        ASSERT_EQ((bool)((results[e / 64] >> (e % 64)) & 1), condParserExecute(&first, &env));
+    }
+
+    // a ruleset groups by the union of its rules' slots
+    ASSERT_TRUE(condParserProjectionMask(&second, mask));
+    ASSERT_EQ(condParserDedupRows(mask, rowWords, rows, rowWords, numEnvs, &dedup), 32);
+    for (int e = 0; e < numEnvs; e++)
+    {
+        const CondParserEnv env = { .bits = rows + e * rowWords };
+        const CondParserEnv group = { .bits = rows + representatives[groups[e]] * rowWords };
+        ASSERT_EQ(condParserExecute(&first, &env), condParserExecute(&first, &group));
+        ASSERT_EQ(condParserExecute(&second, &env), condParserExecute(&second, &group));
+    }
+
+    // too few buckets
+    CondParserDedup small = { .buckets = buckets, .capacity = 16, .groups = groups, .representatives = representatives };
+    ASSERT_EQ(condParserDedupRows(mask, rowWords, rows, rowWords, numEnvs, &small), -1);
+
+    // rules reading fields can't be grouped by slots alone, their slots are still added
+    const CondParserSymbols fieldSymbols = { .getSlot = condParserTestGetSlot, .getField = condParserTestGetField, .getEnumerator = condParserTestGetEnumerator };
+    CondParserProgram third = { .code = code1, .capacity = sizeof(code1) };
+    ASSERT_TRUE(condParserCompile("b && gpu in (nvidia)", &fieldSymbols, condParserTestError, &third));
+    uint64_t fieldMask[1] = { 0 };
+    ASSERT_FALSE(condParserProjectionMask(&third, fieldMask));
+    ASSERT_EQ(fieldMask[0], 1ull << 1);
+}
+
+UTEST(condparser, groupedTables) {
+    const CondParserSymbols symbols = { .getSlot = condParserTestGetNumbered };
+    const char* rules[] = {
+        "s0 && s1",
+        "s0 || !s1",
+        "s1 ^ s2",
+        "!s0",
+        "s1 && s0",
+        "s3 || !s3",
+        "atleast(4, s0, s1, s2, s3, s4, s5, s6)",
+        "s10 && s11 || s12",
+        "s13 -> s14",
+        "s15 ? s16 : s17",
+        "s0 && (s18 || !s18)",
+        "s2 && s3 && s4 && s5"
+    };
+    const int numRules = sizeof(rules) / sizeof(rules[0]);
+
+    unsigned char code[12][64];
+    CondParserProgram programs[12];
+    CondParserRuleInfo info[12];
+    for (int r = 0; r < numRules; r++)
+    {
+        CondParserProgram program = { .code = code[r], .capacity = sizeof(code[r]) };
+        ASSERT_TRUE_MSG(condParserCompile(rules[r], &symbols, condParserTestError, &program), rules[r]);
+        programs[r] = program;
+    }
+
+    int order[12];
+    uint64_t settleTrue[12], settleFalse[12];
+    CondParserRuleset ruleset = { .rules = programs, .info = info, .numRules = numRules, .order = order, .settleTrue = settleTrue, .settleFalse = settleFalse };
+    condParserAnalyzeRuleset(&ruleset, 100000);
+
+    // the duplicate, the constant and the 7 slot rule are left out, the rest fit in three groups of at most 6 slots
+    CondParserTableGroup tableGroups[4];
+    int groupRules[12];
+    uint64_t tables[12], grouped[1];
+    CondParserTableGroups groups = { tableGroups, 4, 0, groupRules, tables, grouped };
+    ASSERT_EQ(condParserGroupRuleset(&ruleset, &groups), 9);
+    ASSERT_EQ(groups.numGroups, 3);
+    ASSERT_EQ(grouped[0], 0xf8full);
+    ASSERT_EQ(tableGroups[0].numSlots, 6);
+
+    // the same results as evaluating the rules, with only the 7 slot rule executed
+    uint64_t state = 0x853c49e6748fea9bull;
+    for (int i = 0; i < 500; i++)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t bits = state >> 40;
+        const CondParserEnv env = { .bits = &bits };
+
+        uint64_t expected, results;
+        condParserExecuteRuleset(&ruleset, &env, &expected);
+        ASSERT_TRUE(condParserExecuteGrouped(&ruleset, &groups, &env, &results) <= 1);
+        ASSERT_EQ(results, expected);
+    }
+
+    // out of groups, the remaining rules are evaluated as before
+    CondParserTableGroups single = { tableGroups, 1, 0, groupRules, tables, grouped };
+    ASSERT_EQ(condParserGroupRuleset(&ruleset, &single), 6);
+    ruleset.order = NULL;
+    for (uint64_t bits = 0; bits < 1 << 20; bits += 4099)
+    {
+        const CondParserEnv env = { .bits = &bits };
+        uint64_t expected, results;
+        condParserExecuteRuleset(&ruleset, &env, &expected);
+        condParserExecuteGrouped(&ruleset, &single, &env, &results);
+        ASSERT_EQ(results, expected);
+    }
+}
@@ -0,0 +1,237 @@
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "utest.h"
+
+#include "condparser.h"
+
+static int condParserCppGetSlot(const char* id)
+{
+    return id[0] == 's' ? atoi(id + 1) : -1;
+}
+
+static std::string condParserCppErrors;
+
+static void condParserCppCollectError(const char* message)
+{
+    condParserCppErrors += message;
+}
+
+static int condParserCppAllocations;
+
+template <class T>
+struct CondParserCountingAllocator
+{
+    typedef T value_type;
+
+    CondParserCountingAllocator() noexcept {}
+    template <class U>
+    CondParserCountingAllocator(const CondParserCountingAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        condParserCppAllocations++;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        condParserCppAllocations--;
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    bool operator==(const CondParserCountingAllocator&) const noexcept { return true; }
+    bool operator!=(const CondParserCountingAllocator&) const noexcept { return false; }
+};
+
+typedef condparser::basic_program<CondParserCountingAllocator<unsigned char>> CondParserCountingProgram;
+
+static int condParserCppPoolAllocations[2];
+
+// a stateful allocator that doesn't propagate on move assignment, allocators of different pools are unequal
+template <class T>
+struct CondParserPoolAllocator
+{
+    typedef T value_type;
+
+    int pool;
+
+    explicit CondParserPoolAllocator(int index) noexcept : pool(index) {}
+    template <class U>
+    CondParserPoolAllocator(const CondParserPoolAllocator<U>& other) noexcept : pool(other.pool) {}
+
+    T* allocate(std::size_t n)
+    {
+        condParserCppPoolAllocations[pool]++;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        condParserCppPoolAllocations[pool]--;
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    bool operator==(const CondParserPoolAllocator& other) const noexcept { return pool == other.pool; }
+    bool operator!=(const CondParserPoolAllocator& other) const noexcept { return pool != other.pool; }
+};
+
+typedef condparser::basic_program<CondParserPoolAllocator<unsigned char>> CondParserPoolProgram;
+
+UTEST(condparser, cppProgram) {
+    CondParserSymbols symbols = {};
+    symbols.getSlot = condParserCppGetSlot;
+    static_assert(std::is_nothrow_move_constructible<condparser::program>::value, "moves must not throw");
+    static_assert(!std::is_copy_constructible<condparser::program>::value, "programs are move-only");
+
+    // small programs stay inline, the expression doesn't need a terminator
+    std::string text = "s0 && !s1 || s2 trailing";
+    CondParserCountingProgram small;
+    ASSERT_TRUE(small.compile(std::string_view(text).substr(0, 15), symbols));
+    ASSERT_TRUE(small.is_inline());
+    ASSERT_EQ(condParserCppAllocations, 0);
+
+    uint64_t bits = 0x1;
+    const CondParserEnv env = { &bits, NULL };
+    ASSERT_TRUE(small.execute(env));
+    bits = 0x3;
+    ASSERT_FALSE(small.execute(env));
+
+    // large programs and long expressions go through the allocator
+    std::string expr = "s0";
+    for (int i = 1; i < 60; i++) {
+        expr += (i % 2) ? " && !s" : " || s";
+        expr += std::to_string(i);
+    }
+    CondParserCountingProgram large;
+    ASSERT_TRUE(large.compile(expr, symbols, NULL));
+    ASSERT_FALSE(large.is_inline());
+    ASSERT_TRUE(large.size() > condparser::program::inline_capacity);
+    ASSERT_EQ(condParserCppAllocations, 1);
+
+    // moves copy inline code and hand over allocated buffers
+    std::vector<CondParserCountingProgram> programs;
+    programs.push_back(std::move(small));
+    programs.push_back(std::move(large));
+    programs.emplace_back();
+    ASSERT_TRUE(small.empty());
+    ASSERT_TRUE(large.empty() && large.is_inline());
+    ASSERT_EQ(condParserCppAllocations, 1);
+    ASSERT_TRUE(programs[0].is_inline());
+    ASSERT_FALSE(programs[0].execute(env));
+
+    ASSERT_EQ(programs[1].execute(env), condParserExecute(programs[1].get(), &env));
+
+    programs[2] = std::move(programs[1]);
+    ASSERT_TRUE(programs[1].empty());
+    ASSERT_FALSE(programs[2].is_inline());
+
+    // programs that overflow before folding shrinks them still grow
+    std::string chain = "(s0";
+    for (int i = 1; i < 40; i++) {
+        chain += " && s" + std::to_string(i);
+    }
+    chain += ")";
+    CondParserCountingProgram never;
+    ASSERT_TRUE(never.compile(chain + " && false", symbols));
+    ASSERT_FALSE(never.execute(env));
+    CondParserCountingProgram always;
+    ASSERT_TRUE(always.compile(chain + " || true", symbols));
+    ASSERT_TRUE(always.execute(env));
+    never = CondParserCountingProgram();
+    always = CondParserCountingProgram();
+
+    // a failed compile keeps the program and only reports the errors of the attempt that had room
+    condParserCppErrors.clear();
+    ASSERT_FALSE(programs[2].compile(chain + " &&", symbols, condParserCppCollectError));
+    ASSERT_FALSE(programs[2].empty());
+    ASSERT_EQ(programs[2].execute(env), condParserExecute(programs[2].get(), &env));
+    ASSERT_EQ(condParserCppAllocations, 1);
+    ASSERT_TRUE(condParserCppErrors.find("Error:") == 0);
+    ASSERT_TRUE(condParserCppErrors.find("too small") == std::string::npos);
+
+    programs.clear();
+    ASSERT_EQ(condParserCppAllocations, 0);
+}
+
+UTEST(condparser, cppInternerThreads) {
+    uint64_t buckets[512];
+    const char* names[256];
+    char chars[2048];
+    CondParserInterner shared;
+    condParserInternerInit(&shared, buckets, 512, names, 256, chars, sizeof(chars));
+
+    // threads racing over the same names agree on every slot, names of returned slots read back whole
+    int slots[4][200];
+    bool named[4] = { true, true, true, true };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 200; i++) {
+                int n = (t * 50 + i * 7) % 200;
+                std::string name = "n" + std::to_string(n);
+                slots[t][n] = condParserIntern(&shared, name.c_str(), (int)name.size());
+                const char* stored = condParserInternerName(&shared, slots[t][n]);
+                named[t] = named[t] && stored != NULL && name == stored;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(shared.numSlots, 200);
+    bool seen[200] = { false };
+    for (int n = 0; n < 200; n++) {
+        int slot = slots[0][n];
+        ASSERT_TRUE(slot >= 0 && slot < 200 && !seen[slot]);
+        seen[slot] = true;
+        for (int t = 1; t < 4; t++) {
+            ASSERT_EQ(slots[t][n], slot);
+        }
+        std::string name = "n" + std::to_string(n);
+        ASSERT_STREQ(condParserInternerName(&shared, slot), name.c_str());
+    }
+    for (int t = 0; t < 4; t++) {
+        ASSERT_TRUE(named[t]);
+    }
+}
+
+UTEST(condparser, cppAllocatorPropagation) {
+    CondParserSymbols symbols = {};
+    symbols.getSlot = condParserCppGetSlot;
+    static_assert(std::is_nothrow_move_assignable<condparser::program>::value, "equal allocators move without throwing");
+    static_assert(!std::is_nothrow_move_assignable<CondParserPoolProgram>::value, "unequal allocators may copy");
+
+    std::string expr = "s0";
+    for (int i = 1; i < 60; i++) {
+        expr += (i % 2) ? " && !s" : " || s";
+        expr += std::to_string(i);
+    }
+
+    // moving between pools copies the code into a buffer of the target's pool
+    CondParserPoolProgram first(CondParserPoolAllocator<unsigned char>(0));
+    CondParserPoolProgram second(CondParserPoolAllocator<unsigned char>(1));
+    ASSERT_TRUE(second.compile(expr, symbols));
+    ASSERT_EQ(condParserCppPoolAllocations[1], 1);
+    int size = second.size();
+
+    first = std::move(second);
+    ASSERT_TRUE(second.empty());
+    ASSERT_EQ(first.size(), size);
+    ASSERT_EQ(condParserCppPoolAllocations[0], 1);
+    ASSERT_EQ(condParserCppPoolAllocations[1], 0);
+
+    uint64_t bits = 0x5;
+    const CondParserEnv env = { &bits, NULL };
+    ASSERT_EQ(first.execute(env), condParserExecute(first.get(), &env));
+
+    // small programs are copied inline
+    ASSERT_TRUE(second.compile("s0 || s1", symbols));
+    first = std::move(second);
+    ASSERT_TRUE(first.is_inline());
+    ASSERT_TRUE(first.execute(env));
+    ASSERT_EQ(condParserCppPoolAllocations[0], 0);
+}
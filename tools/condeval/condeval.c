@@ -0,0 +1,675 @@
+/*
+    condeval - evaluates a file of rules against a stream of environments
+
+    condeval [-t threads] [-f bits|ids|bitmap] [-b] [-o output] [-s] rules [input]
+
+    The rules file holds one expression per line, empty lines and lines starting with # are skipped. Rules are
+    numbered from 0 in file order.
+
+    The input starts with a header line naming one identifier per column, separated by commas or tabs. In text mode
+    every following line is a row of the same number of values, a value being true if it starts with 1, t, T, y or Y.
+    In binary mode (-b) the header is followed by rows of (columns + 63) / 64 little-endian 64-bit words, column N
+    being bit (N % 64) of word N / 64. The input is read from stdin if it's omitted or "-".
+
+    For every row, the results of all rules are written as:
+        - bits: a line of one 0 or 1 per rule (default)
+        - ids: a line of the ids of the matching rules, separated by spaces
+        - bitmap: (rules + 63) / 64 little-endian 64-bit words, rule N being bit (N % 64) of word N / 64
+
+    The input is read in blocks, each split between the threads, which parse, transpose and evaluate their rows in
+    bit-sliced batches. -s prints the throughput to stderr.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CONDPARSER_IMPLEMENTATION
+#include "condparser.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define CONDEVAL_BLOCK_SIZE (16 << 20)
+#define CONDEVAL_MAX_THREADS 64
+
+typedef enum
+{
+    CondEvalFormat_Bits,
+    CondEvalFormat_Ids,
+    CondEvalFormat_Bitmap
+} CondEvalFormat;
+
+typedef struct
+{
+    CondParserProgram* programs;
+    int numRules;
+    int numColumns;
+    int* columnSlots;       // slot of every input column
+    int numSlots;
+    char delimiter;
+    bool binary;
+    CondEvalFormat format;
+} CondEvalSetup;
+
+typedef struct
+{
+    const CondEvalSetup* setup;
+    const char* begin;      // text lines or binary rows of the worker
+    const char* end;
+
+    int numRows;
+    uint64_t* rows;
+    size_t rowsCapacity;
+    uint64_t* columns;
+    size_t columnsCapacity;
+    uint64_t* results;
+    size_t resultsCapacity;
+    uint64_t* ruleRows;
+    size_t ruleRowsCapacity;
+    const uint64_t** columnPtrs;
+
+    char* out;
+    size_t outSize;
+    size_t outCapacity;
+
+    int errorRow;           // row of the first malformed line, -1 if none
+    int errorFields;
+} CondEvalWorker;
+
+static void condEvalFatal(const char* message, const char* detail)
+{
+    fprintf(stderr, "Error: %s%s\n", message, detail);
+    exit(1);
+}
+
+static void condEvalError(const char* message)
+{
+    fputs(message, stderr);
+}
+
+// grows a buffer to at least needed elements
+static void* condEvalReserve(void* buffer, size_t* capacity, size_t needed, size_t elementSize)
+{
+    if (needed <= *capacity) {
+        return buffer;
+    }
+
+    size_t grown = *capacity * 2 > needed ? *capacity * 2 : needed;
+    buffer = realloc(buffer, grown * elementSize);
+    if (buffer == NULL) {
+        condEvalFatal("out of memory", "");
+    }
+    *capacity = grown;
+    return buffer;
+}
+
+static double condEvalSeconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int condEvalNumProcessors(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+static char* condEvalReadFile(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        condEvalFatal("cannot open ", path);
+    }
+
+    size_t capacity = 0;
+    char* data = NULL;
+    *size = 0;
+    for (;;) {
+        data = (char*)condEvalReserve(data, &capacity, *size + 65536 + 1, 1);
+        size_t read = fread(data + *size, 1, 65536, file);
+        *size += read;
+        if (read == 0) {
+            break;
+        }
+    }
+    data[*size] = '\0';
+
+    fclose(file);
+    return data;
+}
+
+static void condEvalCompileRules(CondEvalSetup* setup, const char* path, const CondParserSymbols* symbols)
+{
+    size_t size;
+    char* text = condEvalReadFile(path, &size);
+
+    int capacity = 0;
+    setup->programs = NULL;
+    setup->numRules = 0;
+
+    int lineNumber = 0;
+    bool failed = false;
+    for (char* line = text; line < text + size; ) {
+        char* next = strchr(line, '\n');
+        next = next != NULL ? next : text + size;
+        *next = '\0';
+        if (next > line && next[-1] == '\r') {
+            next[-1] = '\0';
+        }
+        lineNumber++;
+
+        const char* expr = line;
+        line = next + 1;
+        while (*expr == ' ' || *expr == '\t') expr++;
+        if (*expr == '\0' || *expr == '#') {
+            continue;
+        }
+
+        if (setup->numRules == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            setup->programs = (CondParserProgram*)realloc(setup->programs, sizeof(CondParserProgram) * capacity);
+            if (setup->programs == NULL) {
+                condEvalFatal("out of memory", "");
+            }
+        }
+
+        // a program is never longer than 16 bytes per character of its rule
+        CondParserProgram* program = &setup->programs[setup->numRules++];
+        program->capacity = 16 * (int)strlen(expr) + 16;
+        program->code = (unsigned char*)malloc((size_t)program->capacity);
+        if (program->code == NULL) {
+            condEvalFatal("out of memory", "");
+        }
+
+        if (!condParserCompile(expr, symbols, NULL, program)) {
+            fprintf(stderr, "%s:%d: ", path, lineNumber);
+            condParserCompile(expr, symbols, condEvalError, program);
+            failed = true;
+        }
+    }
+
+    free(text);
+    if (failed) {
+        exit(1);
+    }
+    if (setup->numRules == 0) {
+        condEvalFatal("no rules in ", path);
+    }
+}
+
+// splits the header into NUL-terminated names and assigns their slots
+static void condEvalReadHeader(CondEvalSetup* setup, char* header, CondParserSymbolTable* table)
+{
+    setup->delimiter = strchr(header, '\t') != NULL ? '\t' : ',';
+
+    // one node per name component and the root
+    int capacity = 2;
+    setup->numColumns = 1;
+    for (const char* c = header; *c; c++) {
+        setup->numColumns += *c == setup->delimiter;
+        capacity += *c == setup->delimiter || *c == '.';
+    }
+
+    const char** names = (const char**)malloc(sizeof(const char*) * setup->numColumns);
+    CondParserSymbolNode* nodes = (CondParserSymbolNode*)malloc(sizeof(CondParserSymbolNode) * capacity);
+    setup->columnSlots = (int*)malloc(sizeof(int) * setup->numColumns);
+    if (names == NULL || nodes == NULL || setup->columnSlots == NULL) {
+        condEvalFatal("out of memory", "");
+    }
+
+    condParserSymbolTableInit(table, nodes, capacity);
+    char* name = header;
+    for (int c = 0; c < setup->numColumns; c++) {
+        char* end = strchr(name, setup->delimiter);
+        end = end != NULL ? end : name + strlen(name);
+        *end = '\0';
+
+        names[c] = name;
+        if (!condParserSymbolTableAdd(table, name)) {
+            condEvalFatal("invalid column name: ", name);
+        }
+        name = end + 1;
+    }
+    condParserSymbolTableAssign(table);
+
+    setup->numSlots = table->numSlots;
+    for (int c = 0; c < setup->numColumns; c++) {
+        setup->columnSlots[c] = condParserSymbolTableSlot(table, names[c]);
+        for (int d = 0; d < c; d++) {
+            if (setup->columnSlots[d] == setup->columnSlots[c]) {
+                condEvalFatal("duplicate column: ", names[c]);
+            }
+        }
+    }
+
+    free(names);
+}
+
+static char* condEvalReadLine(FILE* input)
+{
+    size_t size = 0;
+    size_t capacity = 0;
+    char* line = NULL;
+
+    int c;
+    while ((c = fgetc(input)) != EOF && c != '\n') {
+        line = (char*)condEvalReserve(line, &capacity, size + 2, 1);
+        line[size++] = (char)c;
+    }
+    if (line == NULL) {
+        condEvalFatal("missing header line", "");
+    }
+
+    if (size > 0 && line[size - 1] == '\r') {
+        size--;
+    }
+    line[size] = '\0';
+    return line;
+}
+
+static void condEvalParseText(CondEvalWorker* worker)
+{
+    const CondEvalSetup* setup = worker->setup;
+    int rowWords = (setup->numSlots + 63) / 64;
+
+    for (const char* line = worker->begin; line < worker->end; ) {
+        const char* end = (const char*)memchr(line, '\n', (size_t)(worker->end - line));
+        end = end != NULL ? end : worker->end;
+        const char* next = end + 1;
+        if (end > line && end[-1] == '\r') {
+            end--;
+        }
+        if (end == line) {
+            line = next;
+            continue;
+        }
+
+        worker->rows = (uint64_t*)condEvalReserve(worker->rows, &worker->rowsCapacity, (size_t)(worker->numRows + 1) * rowWords, sizeof(uint64_t));
+        uint64_t* row = worker->rows + (size_t)worker->numRows * rowWords;
+        memset(row, 0, sizeof(uint64_t) * rowWords);
+
+        int numFields = 0;
+        for (const char* field = line; ; field++) {
+            // an empty last field ends the line, past it lies whatever the block held before
+            if (numFields < setup->numColumns && field < end && (*field == '1' || *field == 't' || *field == 'T' || *field == 'y' || *field == 'Y')) {
+                int slot = setup->columnSlots[numFields];
+                row[slot / 64] |= 1ull << (slot % 64);
+            }
+            numFields++;
+
+            field = (const char*)memchr(field, setup->delimiter, (size_t)(end - field));
+            if (field == NULL) {
+                break;
+            }
+        }
+
+        if (numFields != setup->numColumns && worker->errorRow < 0) {
+            worker->errorRow = worker->numRows;
+            worker->errorFields = numFields;
+        }
+
+        worker->numRows++;
+        line = next;
+    }
+}
+
+static void condEvalParseBinary(CondEvalWorker* worker)
+{
+    const CondEvalSetup* setup = worker->setup;
+    int rowWords = (setup->numSlots + 63) / 64;
+    int inputWords = (setup->numColumns + 63) / 64;
+
+    worker->numRows = (int)((worker->end - worker->begin) / (inputWords * 8));
+    worker->rows = (uint64_t*)condEvalReserve(worker->rows, &worker->rowsCapacity, (size_t)worker->numRows * rowWords, sizeof(uint64_t));
+    memset(worker->rows, 0, sizeof(uint64_t) * (size_t)worker->numRows * rowWords);
+
+    const unsigned char* p = (const unsigned char*)worker->begin;
+    for (int r = 0; r < worker->numRows; r++) {
+        uint64_t* row = worker->rows + (size_t)r * rowWords;
+        for (int c = 0; c < setup->numColumns; c++) {
+            if ((p[c / 8] >> (c % 8)) & 1) {
+                int slot = setup->columnSlots[c];
+                row[slot / 64] |= 1ull << (slot % 64);
+            }
+        }
+        p += inputWords * 8;
+    }
+}
+
+static void condEvalFormat(CondEvalWorker* worker)
+{
+    const CondEvalSetup* setup = worker->setup;
+    int ruleWords = (setup->numRules + 63) / 64;
+    worker->outSize = 0;
+
+    for (int r = 0; r < worker->numRows; r++) {
+        const uint64_t* results = worker->ruleRows + (size_t)r * ruleWords;
+
+        // the longest row: every rule matching with a 10 digit id
+        worker->out = (char*)condEvalReserve(worker->out, &worker->outCapacity, worker->outSize + (size_t)setup->numRules * 11 + ruleWords * 8 + 1, 1);
+        char* out = worker->out + worker->outSize;
+
+        if (setup->format == CondEvalFormat_Bitmap) {
+            for (int w = 0; w < ruleWords; w++) {
+                for (int i = 0; i < 8; i++) {
+                    *out++ = (char)(results[w] >> (i * 8));
+                }
+            }
+        }
+        else if (setup->format == CondEvalFormat_Ids) {
+            bool first = true;
+            for (int w = 0; w < ruleWords; w++) {
+                for (uint64_t bits = results[w]; bits != 0; bits &= bits - 1) {
+                    int id = w * 64 + condParserPopcount64((bits & (0 - bits)) - 1);
+                    out += sprintf(out, first ? "%d" : " %d", id);
+                    first = false;
+                }
+            }
+            *out++ = '\n';
+        }
+        else {
+            for (int i = 0; i < setup->numRules; i++) {
+                *out++ = (char)('0' + ((results[i / 64] >> (i % 64)) & 1));
+            }
+            *out++ = '\n';
+        }
+
+        worker->outSize = (size_t)(out - worker->out);
+    }
+}
+
+static void condEvalRun(CondEvalWorker* worker)
+{
+    const CondEvalSetup* setup = worker->setup;
+    worker->numRows = 0;
+    worker->errorRow = -1;
+
+    if (setup->binary) {
+        condEvalParseBinary(worker);
+    }
+    else {
+        condEvalParseText(worker);
+    }
+
+    int numWords = (worker->numRows + 63) / 64;
+    int rowWords = (setup->numSlots + 63) / 64;
+    int ruleWords = (setup->numRules + 63) / 64;
+    if (worker->numRows == 0 || worker->errorRow >= 0) {
+        worker->outSize = 0;
+        return;
+    }
+
+    worker->columns = (uint64_t*)condEvalReserve(worker->columns, &worker->columnsCapacity, (size_t)setup->numSlots * numWords, sizeof(uint64_t));
+    worker->results = (uint64_t*)condEvalReserve(worker->results, &worker->resultsCapacity, (size_t)setup->numRules * numWords, sizeof(uint64_t));
+    worker->ruleRows = (uint64_t*)condEvalReserve(worker->ruleRows, &worker->ruleRowsCapacity, (size_t)worker->numRows * ruleWords, sizeof(uint64_t));
+
+    condParserTransposeRows(worker->rows, rowWords, worker->numRows, worker->columns, setup->numSlots);
+    for (int s = 0; s < setup->numSlots; s++) {
+        worker->columnPtrs[s] = worker->columns + (size_t)s * numWords;
+    }
+
+    const CondParserBatch batch = { worker->columnPtrs, numWords, NULL };
+    for (int i = 0; i < setup->numRules; i++) {
+        condParserExecuteBatch(&setup->programs[i], &batch, worker->results + (size_t)i * numWords);
+    }
+
+    condParserTransposeColumns(worker->results, setup->numRules, worker->numRows, worker->ruleRows, ruleWords);
+    condEvalFormat(worker);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI condEvalThreadMain(LPVOID userData)
+{
+    condEvalRun((CondEvalWorker*)userData);
+    return 0;
+}
+#else
+static void* condEvalThreadMain(void* userData)
+{
+    condEvalRun((CondEvalWorker*)userData);
+    return NULL;
+}
+#endif
+
+static void condEvalRunAll(CondEvalWorker* workers, int numWorkers)
+{
+#ifdef _WIN32
+    HANDLE threads[CONDEVAL_MAX_THREADS];
+    for (int i = 1; i < numWorkers; i++) {
+        threads[i] = CreateThread(NULL, 0, condEvalThreadMain, &workers[i], 0, NULL);
+    }
+    condEvalRun(&workers[0]);
+    for (int i = 1; i < numWorkers; i++) {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+#else
+    pthread_t threads[CONDEVAL_MAX_THREADS];
+    for (int i = 1; i < numWorkers; i++) {
+        pthread_create(&threads[i], NULL, condEvalThreadMain, &workers[i]);
+    }
+    condEvalRun(&workers[0]);
+    for (int i = 1; i < numWorkers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+}
+
+// splits a block between the workers at line or row boundaries
+static void condEvalSplit(const CondEvalSetup* setup, CondEvalWorker* workers, int numWorkers, const char* begin, const char* end)
+{
+    size_t rowBytes = (size_t)(setup->numColumns + 63) / 64 * 8;
+    size_t numRows = (size_t)(end - begin) / rowBytes;
+
+    const char* cur = begin;
+    for (int i = 0; i < numWorkers; i++) {
+        const char* split;
+        if (i == numWorkers - 1) {
+            split = end;
+        }
+        else if (setup->binary) {
+            split = begin + numRows * (i + 1) / numWorkers * rowBytes;
+        }
+        else {
+            split = begin + (size_t)(end - begin) * (i + 1) / numWorkers;
+            split = split < cur ? cur : split;
+            const char* newline = (const char*)memchr(split, '\n', (size_t)(end - split));
+            split = newline != NULL ? newline + 1 : end;
+        }
+
+        workers[i].begin = cur;
+        workers[i].end = split;
+        cur = split;
+    }
+}
+
+static void condEvalUsage(void)
+{
+    fputs("usage: condeval [-t threads] [-f bits|ids|bitmap] [-b] [-o output] [-s] rules [input]\n", stderr);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    CondEvalSetup setup;
+    memset(&setup, 0, sizeof(setup));
+
+    int numWorkers = condEvalNumProcessors();
+    const char* outputPath = NULL;
+    const char* rulesPath = NULL;
+    const char* inputPath = NULL;
+    bool stats = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            numWorkers = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            const char* format = argv[++i];
+            if (strcmp(format, "bits") == 0) setup.format = CondEvalFormat_Bits;
+            else if (strcmp(format, "ids") == 0) setup.format = CondEvalFormat_Ids;
+            else if (strcmp(format, "bitmap") == 0) setup.format = CondEvalFormat_Bitmap;
+            else condEvalUsage();
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-b") == 0) {
+            setup.binary = true;
+        }
+        else if (strcmp(argv[i], "-s") == 0) {
+            stats = true;
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            condEvalUsage();
+        }
+        else if (rulesPath == NULL) {
+            rulesPath = argv[i];
+        }
+        else if (inputPath == NULL) {
+            inputPath = argv[i];
+        }
+        else {
+            condEvalUsage();
+        }
+    }
+
+    if (rulesPath == NULL) {
+        condEvalUsage();
+    }
+    numWorkers = numWorkers < 1 ? 1 : numWorkers > CONDEVAL_MAX_THREADS ? CONDEVAL_MAX_THREADS : numWorkers;
+
+    FILE* input = stdin;
+    if (inputPath != NULL && strcmp(inputPath, "-") != 0) {
+        input = fopen(inputPath, "rb");
+        if (input == NULL) {
+            condEvalFatal("cannot open ", inputPath);
+        }
+    }
+    FILE* output = stdout;
+    if (outputPath != NULL) {
+        output = fopen(outputPath, "wb");
+        if (output == NULL) {
+            condEvalFatal("cannot open ", outputPath);
+        }
+    }
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    char* header = condEvalReadLine(input);
+    CondParserSymbolTable table;
+    condEvalReadHeader(&setup, header, &table);
+
+    CondParserSymbols symbols;
+    memset(&symbols, 0, sizeof(symbols));
+    symbols.table = &table;
+    condEvalCompileRules(&setup, rulesPath, &symbols);
+
+    CondEvalWorker workers[CONDEVAL_MAX_THREADS];
+    memset(workers, 0, sizeof(workers));
+    for (int i = 0; i < numWorkers; i++) {
+        workers[i].setup = &setup;
+        workers[i].columnPtrs = (const uint64_t**)malloc(sizeof(uint64_t*) * (setup.numSlots + 1));
+        if (workers[i].columnPtrs == NULL) {
+            condEvalFatal("out of memory", "");
+        }
+    }
+
+    // text blocks keep their last partial line for the next block
+    size_t rowBytes = (size_t)(setup.numColumns + 63) / 64 * 8;
+    size_t blockSize = setup.binary ? CONDEVAL_BLOCK_SIZE / rowBytes * rowBytes + rowBytes : CONDEVAL_BLOCK_SIZE;
+    char* block = (char*)malloc(blockSize);
+    size_t carry = 0;
+    long long numRows = 0;
+    long long numBytes = 0;
+    double start = condEvalSeconds();
+
+    for (;;) {
+        size_t read = fread(block + carry, 1, blockSize - carry, input);
+        size_t size = carry + read;
+        bool last = read == 0;
+        numBytes += (long long)read;
+
+        size_t used = size;
+        if (setup.binary) {
+            used = size / rowBytes * rowBytes;
+            if (last && used != size) {
+                condEvalFatal("truncated row at the end of the input", "");
+            }
+        }
+        else if (!last) {
+            while (used > 0 && block[used - 1] != '\n') used--;
+            if (used == 0) {
+                condEvalFatal("line longer than a block", "");
+            }
+        }
+
+        condEvalSplit(&setup, workers, numWorkers, block, block + used);
+        condEvalRunAll(workers, numWorkers);
+
+        for (int i = 0; i < numWorkers; i++) {
+            if (workers[i].errorRow >= 0) {
+                fprintf(stderr, "Error: row %lld has %d values, expected %d\n", numRows + workers[i].errorRow + 1, workers[i].errorFields, setup.numColumns);
+                exit(1);
+            }
+            fwrite(workers[i].out, 1, workers[i].outSize, output);
+            numRows += workers[i].numRows;
+        }
+
+        carry = size - used;
+        memmove(block, block + used, carry);
+        if (last) {
+            break;
+        }
+    }
+
+    double seconds = condEvalSeconds() - start;
+    if (stats) {
+        fprintf(stderr, "%lld rows, %d rules, %d threads: %.3f s, %.1f Mrows/s, %.1f MB/s\n", numRows, setup.numRules, numWorkers, seconds,
+            (double)numRows / seconds / 1e6, (double)numBytes / seconds / (1024.0 * 1024.0));
+    }
+
+    for (int i = 0; i < numWorkers; i++) {
+        free(workers[i].rows);
+        free(workers[i].columns);
+        free(workers[i].results);
+        free(workers[i].ruleRows);
+        free((void*)workers[i].columnPtrs);
+        free(workers[i].out);
+    }
+    for (int i = 0; i < setup.numRules; i++) {
+        free(setup.programs[i].code);
+    }
+    free(setup.programs);
+    free(setup.columnSlots);
+    free((void*)table.nodes);
+    free(header);
+    free(block);
+
+    if (input != stdin) {
+        fclose(input);
+    }
+    if (output != stdout) {
+        fclose(output);
+    }
+    return 0;
+}
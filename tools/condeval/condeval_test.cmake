@@ -0,0 +1,17 @@
+# runs condeval over small inputs and compares its output, invoked by ctest with -DCONDEVAL=<path to condeval>
+
+function(condeval_expect name rules input expected)
+    set(dir ${CMAKE_CURRENT_BINARY_DIR}/condeval_test)
+    file(MAKE_DIRECTORY ${dir})
+    file(WRITE ${dir}/${name}.rules "${rules}")
+    file(WRITE ${dir}/${name}.csv "${input}")
+    execute_process(COMMAND ${CONDEVAL} ${dir}/${name}.rules ${dir}/${name}.csv OUTPUT_VARIABLE output RESULT_VARIABLE result)
+    if(NOT result EQUAL 0 OR NOT output STREQUAL expected)
+        message(FATAL_ERROR "${name}: expected \"${expected}\", got \"${output}\" (exit code ${result})")
+    endif()
+endfunction()
+
+condeval_expect(rows "a && !b\nc\n" "a,b,c\n1,0,1\n1,1,0\n" "11\n00\n")
+
+# the last line has no newline and ends with an empty field, the byte after it is a stale '1' of the previous line
+condeval_expect(emptyLastField "c\n" "a,b,c\n1,1,1\n1,0," "1\n0\n")